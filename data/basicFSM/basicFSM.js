@@ -15,21 +15,123 @@ function showStatus(message, isError = false) {
   setTimeout(() => statusDiv.style.display = 'none', 3000);
 }
 
+// Opt-in: store text assets gzip-compressed on the device (needs CompressionStream)
+const gzipTextUploads = false;
+
+// Upload .tar / .tar.gz files as archives that are extracted into the current folder
+const extractArchives = true;
+
+function uploadQuery(upload) {
+  if (upload.extract) return '?extract=tar';
+  return upload.compressed ? '?compressed=gzip' : '';
+}
+
+// Text shown after an upload, the device answers with a JSON report
+function uploadResultText(text) {
+  try {
+    const report = JSON.parse(text);
+    if (report.entries) return `Archive extracted: ${report.extracted} entries, ${report.skipped} skipped`;
+    if (report.files) {
+      if (report.success) return `${report.uploaded} file(s) uploaded`;
+      const failures = report.files.filter(file => file.status !== 200).map(file => `${file.name}: ${file.message}`);
+      return `${report.uploaded} uploaded, ${report.failed} failed (${failures.join('; ') || report.error})`;
+    }
+  } catch (e) {
+    // Plain text answer
+  }
+  return text;
+}
+
+// Folders are listed in pages, the next page is loaded when the list is scrolled to its end
+const listPageSize = 100;
+let listPaging = null;
+
+function listPageUrl(path, cursor) {
+  let url = '/fsm/filelist?folder=' + encodeURIComponent(path) + '&limit=' + listPageSize;
+  if (cursor) url += '&cursor=' + encodeURIComponent(cursor);
+  return url;
+}
+
+function loadMoreFiles() {
+  if (!listPaging || listPaging.loading || !listPaging.data.nextCursor) return;
+  listPaging.loading = true;
+  fetch(listPageUrl(listPaging.path, listPaging.data.nextCursor))
+    .then(response => {
+      if (response.status === 409) {
+        // The folder changed since the first page, start over
+        listPaging = null;
+        loadFileList();
+        return null;
+      }
+      if (!response.ok) throw new Error(`HTTP error! status: ${response.status}`);
+      return response.json();
+    })
+    .then(page => {
+      if (!page || !listPaging) return;
+      listPaging.data.files = listPaging.data.files.concat(page.files);
+      listPaging.data.nextCursor = page.nextCursor;
+      listPaging.loading = false;
+      renderFileList(listPaging.path, listPaging.data);
+    })
+    .catch(error => {
+      if (listPaging) listPaging.loading = false;
+      showStatus('Failed to load more files: ' + error, true);
+    });
+}
+
+// scroller is the scrolling list element, or null when the page itself scrolls
+function loadMoreIfAtEnd(scroller) {
+  const atEnd = scroller
+    ? scroller.scrollTop + scroller.clientHeight >= scroller.scrollHeight - 100
+    : window.innerHeight + window.scrollY >= document.body.offsetHeight - 100;
+  if (atEnd) loadMoreFiles();
+}
+
+window.addEventListener('scroll', () => loadMoreIfAtEnd(null));
+
+function prepareUpload(file) {
+  // Archives are unpacked on the device, a .tar.gz is inflated here first
+  if (extractArchives && /\.(tar|tar\.gz|tgz)$/i.test(file.name)) {
+    if (/\.tar$/i.test(file.name)) {
+      return Promise.resolve({ blob: file, compressed: false, extract: true });
+    }
+    if (typeof DecompressionStream === 'undefined') {
+      return Promise.reject(new Error('This browser cannot unpack .tar.gz, upload a .tar'));
+    }
+    return new Response(file.stream().pipeThrough(new DecompressionStream('gzip'))).blob()
+      .then(blob => ({ blob: blob, compressed: false, extract: true }));
+  }
+  const isText = /\.(html?|css|js|json|svg|txt|csv|xml)$/i.test(file.name);
+  if (!gzipTextUploads || !isText || typeof CompressionStream === 'undefined') {
+    return Promise.resolve({ blob: file, compressed: false });
+  }
+  return new Response(file.stream().pipeThrough(new CompressionStream('gzip'))).blob()
+    .then(blob => ({ blob: blob, compressed: true }));
+}
+
+// Name shown for a file, precompressed assets show their logical name and ratio
+function displayName(file) {
+  if (!file.logicalName || !file.originalSize) return file.name;
+  const ratio = Math.round((file.size / file.originalSize) * 100);
+  return `${file.logicalName} (gz ${ratio}%)`;
+}
+
 function handleUpload(event) {
   event.preventDefault();
   const form = event.target;
   const fileInput = form.querySelector('input[type="file"]');
-  const file = fileInput.files[0];
+  const files = Array.from(fileInput.files);
   
-  if (!file) {
+  if (files.length === 0) {
     showStatus('Please select a file', true);
     return;
   }
   
-  console.log("Selected file:", file.name, "Size:", file.size, "bytes");
+  const totalSize = files.reduce((sum, file) => sum + file.size, 0);
+  console.log("Selected files:", files.length, "Size:", totalSize, "bytes");
   
-  // Check if there's enough space before uploading
-  fetch('/fsm/checkSpace?size=' + file.size)
+  // Check once if there's enough space for all files before uploading
+  fetch('/fsm/checkSpace?size=' + totalSize)
     .then(response => {
       if (!response.ok) {
         return response.text().then(text => {
@@ -38,28 +140,39 @@ function handleUpload(event) {
       }
       return response.text();
     })
-    .then(() => {
-      // If we get here, there's enough space, proceed with upload
-      const formData = new FormData(form);
-      
-      // Add current folder to formData
+    .then(() => Promise.all(files.map(prepareUpload)))
+    .then(uploads => {
+      // Plain files go to the device in one request and compressed files in
+      // another (marked with ?compressed=gzip, which both server backends
+      // see), archives that are extracted get a request of their own
+      const requests = [];
+      const formData = new FormData();
+      const gzipData = new FormData();
       formData.append('folder', currentPath);
-      
-      return fetch(form.action, {
-        method: 'POST',
-        body: formData
+      gzipData.append('folder', currentPath);
+      uploads.forEach((upload, i) => {
+        if (upload.extract) {
+          const archiveData = new FormData();
+          archiveData.append('folder', currentPath);
+          archiveData.append('file', upload.blob, files[i].name);
+          requests.push({ query: uploadQuery(upload), body: archiveData });
+        } else {
+          (upload.compressed ? gzipData : formData).append('file', upload.blob, files[i].name);
+        }
       });
+      if (uploads.some(upload => !upload.extract && upload.compressed)) requests.unshift({ query: '?compressed=gzip', body: gzipData });
+      if (uploads.some(upload => !upload.extract && !upload.compressed)) requests.unshift({ query: '', body: formData });
+
+      // One request after the other, the device receives one upload at a time
+      return requests.reduce((chain, request) => chain.then(results =>
+        fetch(form.action + request.query, { method: 'POST', body: request.body })
+          .then(response => response.text().then(text => {
+            if (!response.ok) throw new Error(uploadResultText(text) || 'Upload failed');
+            return results.concat(uploadResultText(text));
+          }))), Promise.resolve([]));
     })
-    .then(response => {
-      if (!response.ok) {
-        return response.text().then(text => {
-          throw new Error(text || 'Upload failed');
-        });
-      }
-      return response.text();
-    })
-    .then(result => {
-      showStatus(result);
+    .then(results => {
+      showStatus(results.join(', '));
       form.reset();
       loadFileList();
     })
@@ -67,7 +180,7 @@ function handleUpload(event) {
 }
 
 function loadFileList(path = currentPath) {
-  fetch('/fsm/filelist?folder=' + encodeURIComponent(path))
+  fetch(listPageUrl(path))
     .then(response => {
       if (!response.ok) {
         if (response.status === 400) {
@@ -96,66 +209,76 @@ function loadFileList(path = currentPath) {
       if (!data || !Array.isArray(data.files)) {
         throw new Error('Invalid response format');
       }
-      const filesDiv = document.getElementById('files');
-      const spaceInfo = document.getElementById('spaceInfo');
-      let html = '<div style="margin-bottom: 10px;">';
-      if (currentPath !== '/') {
-        html += `<button class="button" style="width: auto;" onclick="navigateToFolder('${getParentFolder(currentPath)}')">.. &#8617;</button>`;
-        html += `<span style="margin-left: 10px;">Current path: ${currentPath}</span>`;
+      listPaging = { path: path, data: data, loading: false };
+      renderFileList(path, data);
+    })
+    .catch(error => showStatus('Failed to load file list: ' + error, true));
+}
+
+function renderFileList(path, data) {
+  const filesDiv = document.getElementById('files');
+  const spaceInfo = document.getElementById('spaceInfo');
+  let html = '<div style="margin-bottom: 10px;">';
+  if (currentPath !== '/') {
+    html += `<button class="button" style="width: auto;" onclick="navigateToFolder('${getParentFolder(currentPath)}')">.. &#8617;</button>`;
+    html += `<span style="margin-left: 10px;">Current path: ${currentPath}</span>`;
+  }
+  html += '</div>';
+  
+  html += '<table style="width: 100%; border-collapse: collapse;">';
+  html += '<tr style="background-color: #f2f2f2;"><th style="text-align: left; padding: 8px;">Name</th><th style="text-align: right; padding: 8px;">Size</th><th style="text-align: right; padding: 8px;">Actions</th></tr>';
+  
+  if (data.files.length === 0) {
+    html += '<tr><td colspan="3" style="text-align: center; padding: 20px;">Empty folder</td></tr>';
+  } else {
+    // First show folders
+    data.files.forEach(file => {
+      if (file.isDir) {
+        const fullPath = currentPath + (currentPath.endsWith('/') ? '' : '/') + file.name;
+        const isReadOnly = file.access === "r";
+        html += `<tr style="border-bottom: 1px solid #ddd;">
+          <td style="padding: 8px; cursor: pointer;" onclick="navigateToFolder('${fullPath}')">&#128193; ${file.name}</td>
+          <td style="text-align: right; padding: 8px;">${file.size} files</td>
+          <td style="text-align: right; padding: 8px;">
+            ${isReadOnly ? 
+              `<button class="button delete" style="width: auto; padding: 5px 10px; margin: 2px; background-color: #cccccc; cursor: not-allowed;" disabled>Locked</button>` : 
+              `<button class="button delete" style="width: auto; padding: 5px 10px; margin: 2px;" onclick="deleteFolder('${file.name}')">Delete</button>`
+            }
+          </td>
+        </tr>`;
       }
-      html += '</div>';
-      
-      html += '<table style="width: 100%; border-collapse: collapse;">';
-      html += '<tr style="background-color: #f2f2f2;"><th style="text-align: left; padding: 8px;">Name</th><th style="text-align: right; padding: 8px;">Size</th><th style="text-align: right; padding: 8px;">Actions</th></tr>';
-      
-      if (data.files.length === 0) {
-        html += '<tr><td colspan="3" style="text-align: center; padding: 20px;">Empty folder</td></tr>';
-      } else {
-        // First show folders
-        data.files.forEach(file => {
-          if (file.isDir) {
-            const fullPath = currentPath + (currentPath.endsWith('/') ? '' : '/') + file.name;
-            const isReadOnly = file.access === "r";
-            html += `<tr style="border-bottom: 1px solid #ddd;">
-              <td style="padding: 8px; cursor: pointer;" onclick="navigateToFolder('${fullPath}')">&#128193; ${file.name}</td>
-              <td style="text-align: right; padding: 8px;">${file.size} files</td>
-              <td style="text-align: right; padding: 8px;">
-                ${isReadOnly ? 
-                  `<button class="button delete" style="width: auto; padding: 5px 10px; margin: 2px; background-color: #cccccc; cursor: not-allowed;" disabled>Locked</button>` : 
-                  `<button class="button delete" style="width: auto; padding: 5px 10px; margin: 2px;" onclick="deleteFolder('${file.name}')">Delete</button>`
-                }
-              </td>
-            </tr>`;
-          }
-        });
+    });
 
-        // Then show files
-        data.files.forEach(file => {
-          if (!file.isDir) {
-            const isReadOnly = file.access === "r";
-            html += `<tr style="border-bottom: 1px solid #ddd;">
-              <td style="padding: 8px;">&#128196; ${file.name}</td>
-              <td style="text-align: right; padding: 8px;">${formatBytes(file.size)}</td>
-              <td style="text-align: right; padding: 8px;">
-                <button class="button download" style="width: auto; padding: 5px 10px; margin: 2px;" onclick="downloadFile('${file.name}')">Download</button>
-                ${isReadOnly ? 
-                  `<button class="button delete" style="width: auto; padding: 5px 10px; margin: 2px; background-color: #cccccc; cursor: not-allowed;" disabled>Locked</button>` : 
-                  `<button class="button delete" style="width: auto; padding: 5px 10px; margin: 2px;" onclick="deleteFile('${file.name}')">Delete</button>`
-                }
-              </td>
-            </tr>`;
-          }
-        });
+    // Then show files
+    data.files.forEach(file => {
+      if (!file.isDir) {
+        const isReadOnly = file.access === "r";
+        html += `<tr style="border-bottom: 1px solid #ddd;">
+          <td style="padding: 8px;">&#128196; ${displayName(file)}</td>
+          <td style="text-align: right; padding: 8px;">${formatBytes(file.size)}</td>
+          <td style="text-align: right; padding: 8px;">
+            <button class="button download" style="width: auto; padding: 5px 10px; margin: 2px;" onclick="downloadFile('${file.logicalName || file.name}')">Download</button>
+            ${isReadOnly ? 
+              `<button class="button delete" style="width: auto; padding: 5px 10px; margin: 2px; background-color: #cccccc; cursor: not-allowed;" disabled>Locked</button>` : 
+              `<button class="button delete" style="width: auto; padding: 5px 10px; margin: 2px;" onclick="deleteFile('${file.name}')">Delete</button>`
+            }
+          </td>
+        </tr>`;
       }
-      html += '</table>';
-      filesDiv.innerHTML = html;
+    });
+  }
+  html += '</table>';
+  if (data.nextCursor) {
+    html += `<p style="text-align: center;">${data.files.length} of ${data.total} shown &nbsp;
+      <button class="button" style="width: auto;" onclick="loadMoreFiles()">Load more</button></p>`;
+  }
+  filesDiv.innerHTML = html;
 
-      const usedSpace = formatBytes(data.usedSpace || 0);
-      const totalSpace = formatBytes(data.totalSpace || 0);
-      const freeSpace = formatBytes (data.totalSpace - data.usedSpace || 0);
-      spaceInfo.innerHTML = `<p>Storage: ${usedSpace} used of ${totalSpace} free (${freeSpace} available)</p>`;
-    })
-    .catch(error => showStatus('Failed to load file list: ' + error, true));
+  const usedSpace = formatBytes(data.usedSpace || 0);
+  const totalSpace = formatBytes(data.totalSpace || 0);
+  const freeSpace = formatBytes (data.totalSpace - data.usedSpace || 0);
+  spaceInfo.innerHTML = `<p>Storage: ${usedSpace} used of ${totalSpace} free (${freeSpace} available)</p>`;
+  loadMoreIfAtEnd(null);
 }
 
 function formatBytes(bytes) {
@@ -213,22 +336,29 @@ function createFolder() {
 }
 
 function deleteFolder(foldername) {
-  if (!confirm('Are you sure you want to delete folder ' + foldername + '?')) return;
+  if (!confirm('Are you sure you want to delete folder ' + foldername + ' and everything in it?')) return;
 
   const fullPath = currentPath + (currentPath.endsWith('/') ? '' : '/') + foldername;
+  sendFolderDelete(fullPath);
+}
+
+// A large folder may take several requests: the device answers 202 while
+// there is more to remove
+function sendFolderDelete(fullPath) {
   fetch('/fsm/deleteFolder', {
     method: 'POST',
     headers: {'Content-Type': 'application/x-www-form-urlencoded'},
-    body: 'folder=' + encodeURIComponent(fullPath)
+    body: 'folder=' + encodeURIComponent(fullPath) + '&recursive=1'
   })
-  .then(response => response.text())
-  .then(result => {
+  .then(response => response.text().then(result => {
     showStatus(result);
-    if (result.includes('deleted')) {
+    if (response.status === 202) {
+      sendFolderDelete(fullPath);
+    } else if (result.includes('deleted')) {
       document.getElementById('foldername').value = '';
       loadFileList();
     }
-  })
+  }))
   .catch(error => showStatus('Failed to delete folder: ' + error, true));
 }
 
@@ -60,7 +60,7 @@ document.addEventListener('DOMContentLoaded', function() {
             
             // Display selected filename
             if (selectedFileName) {
-                selectedFileName.textContent = 'Selected: ' + fileInput.files[0].name;
+                selectedFileName.textContent = 'Selected: ' + Array.from(fileInput.files).map(file => file.name).join(', ');
             }
         } else {
             // Disable upload button if no file selected
@@ -86,8 +86,8 @@ function uploadSelectedFile() {
     return;
   }
   
-  // Upload the selected file
-  uploadFile(fileInput.files[0]);
+  // Upload the selected files
+  uploadFiles(Array.from(fileInput.files));
   
   // Close the popup
   const popup = document.querySelector('.popup-container');
@@ -96,18 +96,118 @@ function uploadSelectedFile() {
   }
 }
 
-function uploadFile(file) {
-  console.log('uploadFile() called, Uploading file:', file.name);
+// Opt-in: store text assets gzip-compressed on the device (needs CompressionStream)
+const gzipTextUploads = false;
 
-  if (!file) {
+// Upload .tar / .tar.gz files as archives that are extracted into the current folder
+const extractArchives = true;
+
+function uploadQuery(upload) {
+  if (upload.extract) return '?extract=tar';
+  return upload.compressed ? '?compressed=gzip' : '';
+}
+
+// Text shown after an upload, the device answers with a JSON report
+function uploadResultText(text) {
+  try {
+    const report = JSON.parse(text);
+    if (report.entries) return `Archive extracted: ${report.extracted} entries, ${report.skipped} skipped`;
+    if (report.files) {
+      if (report.success) return `${report.uploaded} file(s) uploaded`;
+      const failures = report.files.filter(file => file.status !== 200).map(file => `${file.name}: ${file.message}`);
+      return `${report.uploaded} uploaded, ${report.failed} failed (${failures.join('; ') || report.error})`;
+    }
+  } catch (e) {
+    // Plain text answer
+  }
+  return text;
+}
+
+// Folders are listed in pages, the next page is loaded when the list is scrolled to its end
+const listPageSize = 100;
+let listPaging = null;
+
+function listPageUrl(path, cursor) {
+  let url = '/fsm/filelist?folder=' + encodeURIComponent(path) + '&limit=' + listPageSize;
+  if (cursor) url += '&cursor=' + encodeURIComponent(cursor);
+  return url;
+}
+
+function loadMoreFiles() {
+  if (!listPaging || listPaging.loading || !listPaging.data.nextCursor) return;
+  listPaging.loading = true;
+  fetch(listPageUrl(listPaging.path, listPaging.data.nextCursor))
+    .then(response => {
+      if (response.status === 409) {
+        // The folder changed since the first page, start over
+        listPaging = null;
+        loadFileList();
+        return null;
+      }
+      if (!response.ok) throw new Error(`HTTP error! status: ${response.status}`);
+      return response.json();
+    })
+    .then(page => {
+      if (!page || !listPaging) return;
+      listPaging.data.files = listPaging.data.files.concat(page.files);
+      listPaging.data.nextCursor = page.nextCursor;
+      listPaging.loading = false;
+      renderFileList(listPaging.path, listPaging.data);
+    })
+    .catch(error => {
+      if (listPaging) listPaging.loading = false;
+      console.error('Failed to load more files:', error);
+    });
+}
+
+// scroller is the scrolling list element, or null when the page itself scrolls
+function loadMoreIfAtEnd(scroller) {
+  const atEnd = scroller
+    ? scroller.scrollTop + scroller.clientHeight >= scroller.scrollHeight - 100
+    : window.innerHeight + window.scrollY >= document.body.offsetHeight - 100;
+  if (atEnd) loadMoreFiles();
+}
+
+function prepareUpload(file) {
+  // Archives are unpacked on the device, a .tar.gz is inflated here first
+  if (extractArchives && /\.(tar|tar\.gz|tgz)$/i.test(file.name)) {
+    if (/\.tar$/i.test(file.name)) {
+      return Promise.resolve({ blob: file, compressed: false, extract: true });
+    }
+    if (typeof DecompressionStream === 'undefined') {
+      return Promise.reject(new Error('This browser cannot unpack .tar.gz, upload a .tar'));
+    }
+    return new Response(file.stream().pipeThrough(new DecompressionStream('gzip'))).blob()
+      .then(blob => ({ blob: blob, compressed: false, extract: true }));
+  }
+  const isText = /\.(html?|css|js|json|svg|txt|csv|xml)$/i.test(file.name);
+  if (!gzipTextUploads || !isText || typeof CompressionStream === 'undefined') {
+    return Promise.resolve({ blob: file, compressed: false });
+  }
+  return new Response(file.stream().pipeThrough(new CompressionStream('gzip'))).blob()
+    .then(blob => ({ blob: blob, compressed: true }));
+}
+
+// Name shown for a file, precompressed assets show their logical name and ratio
+function displayName(file) {
+  if (!file.logicalName || !file.originalSize) return file.name;
+  const ratio = Math.round((file.size / file.originalSize) * 100);
+  return `${file.logicalName} (gz ${ratio}%)`;
+}
+
+function uploadFiles(files) {
+  console.log('uploadFiles() called, Uploading ' + files.length + ' file(s)');
+
+  if (files.length === 0) {
       console.log('No file selected');
       return;
   }
   
   // Check for filename issues
-  if (file.name.length > 31) {
+  const longName = files.find(file => file.name.length > 31);
+  if (longName) {
     console.error('Filename too long (max 31 characters)');
-    alert('Filename too long. Please rename the file to be shorter than 31 characters.');
+    alert('Filename ' + longName.name + ' too long. Please rename the file to be shorter than 31 characters.');
     return;
   }
   
@@ -117,64 +217,95 @@ function uploadFile(file) {
       uploadFolder += '/';
   }
   
-  console.log('Starting upload for file['+ file.name+ '] to folder['+ uploadFolder +']');
-
-  const formData = new FormData();
-  formData.append('file', file);
-  formData.append('folder', uploadFolder);
+  console.log('Starting upload of ' + files.length + ' file(s) to folder['+ uploadFolder +']');
+
+  // All files go to the device in one request, archives that are extracted
+  // get a request of their own. The requests are sent one after the other.
+  Promise.all(files.map(prepareUpload))
+    .then(uploads => {
+      // Plain and compressed files go in one request each, the compressed
+      // one is marked with ?compressed=gzip, which both server backends see
+      const requests = [];
+      const plain = uploads.map((upload, i) => i).filter(i => !uploads[i].extract && !uploads[i].compressed);
+      const packed = uploads.map((upload, i) => i).filter(i => !uploads[i].extract && uploads[i].compressed);
+      if (plain.length > 0) requests.push({ files: plain.map(i => files[i]), uploads: plain.map(i => uploads[i]), query: '' });
+      if (packed.length > 0) requests.push({ files: packed.map(i => files[i]), uploads: packed.map(i => uploads[i]), query: '?compressed=gzip' });
+      uploads.forEach((upload, i) => {
+        if (upload.extract) requests.push({ files: [files[i]], uploads: [upload], query: uploadQuery(upload) });
+      });
+      return requests.reduce((chain, request) => chain.then(() => sendUpload(request.files, request.uploads, uploadFolder, request.query)), Promise.resolve());
+    })
+    .catch(error => alert('Upload failed: ' + error.message));
+
+} // uploadFiles()
+
+
+function sendUpload(files, uploads, uploadFolder, query) {
+  return new Promise(resolve => {
+    // The folder has to come before the files, the device reads it at the first file
+    const formData = new FormData();
+    formData.append('folder', uploadFolder);
+    uploads.forEach((upload, i) => formData.append('file', upload.blob, files[i].name));
   
-  const xhr = new XMLHttpRequest();
-  xhr.open('POST', '/fsm/upload', true);
+    const xhr = new XMLHttpRequest();
+    xhr.open('POST', '/fsm/upload' + query, true);
   
-  xhr.upload.onprogress = function(e) {
-      if (e.lengthComputable) {
-          const percentComplete = (e.loaded / e.total) * 100;
-          console.log('Upload progress: ' + percentComplete.toFixed(2) + '%');
-      }
-  };
+    xhr.upload.onprogress = function(e) {
+        if (e.lengthComputable) {
+            const percentComplete = (e.loaded / e.total) * 100;
+            console.log('Upload progress: ' + percentComplete.toFixed(2) + '%');
+        }
+    };
   
-  xhr.onload = function() {
-      if (xhr.status === 200) {
-          console.log('Upload completed successfully');
+    xhr.onload = function() {
+        if (xhr.status === 200) {
+            console.log('Upload completed successfully');
           
-          // Check response body for potential errors
-          try {
-              const response = JSON.parse(xhr.responseText);
-              if (response.error) {
-                  console.error('Server reported error:', response.error);
-                  alert('Upload failed: ' + response.error);
-                  return;
-              }
-              if (response.success === false) {
-                  console.error('Server reported failure');
-                  alert('Upload failed. The server could not save the file.');
-                  return;
-              }
-          } catch (e) {
-              // Response might not be JSON, which is fine
-              console.log('Response is not JSON, assuming success');
-          }
+            // Check response body for potential errors
+            try {
+                const response = JSON.parse(xhr.responseText);
+                if (response.error) {
+                    console.error('Server reported error:', response.error);
+                    alert('Upload failed: ' + response.error);
+                    resolve();
+                    return;
+                }
+                if (response.success === false) {
+                    console.error('Server reported failure');
+                    alert('Upload failed. The server could not save the file.');
+                    resolve();
+                    return;
+                }
+                console.log(uploadResultText(xhr.responseText));
+            } catch (e) {
+                // Response might not be JSON, which is fine
+                console.log('Response is not JSON, assuming success');
+            }
           
-          // Set the reset state to ignore the currentFolder from the server
-          isResettingToRoot = true;
+            // Set the reset state to ignore the currentFolder from the server
+            isResettingToRoot = true;
           
-          loadFileList();
-      } else {
-          console.error('Upload failed with status:', xhr.status);
-          console.error('Response:', xhr.responseText);
-          alert('Upload failed with status: ' + xhr.status);
-      }
-  };
+            loadFileList();
+        } else {
+            console.error('Upload failed with status:', xhr.status);
+            console.error('Response:', xhr.responseText);
+            alert('Upload failed with status: ' + xhr.status + '\n' + uploadResultText(xhr.responseText));
+            loadFileList();
+        }
+        resolve();
+    };
   
-  xhr.onerror = function() {
-      console.error('Upload failed due to network error');
-      alert('Upload failed due to network error');
-  };
+    xhr.onerror = function() {
+        console.error('Upload failed due to network error');
+        alert('Upload failed due to network error');
+        resolve();
+    };
   
-  console.log('Sending upload request...');
-  xhr.send(formData);
+    console.log('Sending upload request...');
+    xhr.send(formData);
+  });
 
-} // uploadFile()
+} // sendUpload()
 
 
 // Add a flag to track if we're in a reset state
@@ -198,7 +329,7 @@ if (spaceInfoElement) {
   }
 
   var xhr = new XMLHttpRequest();
-  xhr.open('GET', '/fsm/filelist?folder=' + currentFolder, true);
+  xhr.open('GET', listPageUrl(currentFolder), true);
   
   xhr.onload = function() {
       if (xhr.status === 200) {
@@ -215,123 +346,10 @@ if (spaceInfoElement) {
               isResettingToRoot = false; // Clear the reset state
           }
           
-          var fileListElement = document.getElementById('fsm_fileList');
-          if (!fileListElement) {
-              console.error('fileList element not found in DOM');
-              return;
-          }
-          fileListElement.innerHTML = '';
-          
-          // Create or update the file list header to display the current folder name
-          var headerElement = document.querySelector('.FSM_file-list-header');
-          if (!headerElement) {
-              headerElement = document.createElement('div');
-              headerElement.className = 'FSM_file-list-header';
-              fileListElement.parentNode.insertBefore(headerElement, fileListElement);
-          }
-          
-          // Remove trailing '/' from folder name for display
-          var displayFolderName = currentFolder;
-          if (displayFolderName !== '/' && displayFolderName.endsWith('/')) {
-              displayFolderName = displayFolderName.slice(0, -1);
-          }
-          headerElement.textContent = displayFolderName;
-          //-- Initially hide the header when it is created
-          headerElement.style.display = 'none';
-          
-          // Create arrays for folders and files
-          // Remove duplicates by using a Map with folder name as key
-          var folderMap = new Map();
-          var files = [];
-          
-          for (var i = 0; i < data.files.length; i++) {
-              var file = data.files[i];
-              if (file.isDir) {
-                  // Only add if not already in the map
-                  if (!folderMap.has(file.name)) {
-                      folderMap.set(file.name, file);
-                  }
-              } else {
-                  files.push(file);
-              }
-          }
-          
-          // Convert map back to array
-          var folders = Array.from(folderMap.values());
-
-          console.log('Found folders:', folders.length, 'files:', files.length);
-
-          // Sort folders and files alphabetically
-          files.sort(function(a, b) { return a.name.localeCompare(b.name); });
-          folders.sort(function(a, b) { return a.name.localeCompare(b.name); });
-
-          var itemCount = 0;
-
-          if (currentFolder !== '/') {
-              itemCount++;
-              var backItem = document.createElement('li');
-              backItem.classList.add('FSM_file-item');
-              backItem.innerHTML = `<span style="cursor: pointer" onclick="navigateUp()"><span class="FSM_folder-icon">${folderUpIcon}</span></span><span class="FSM_size"></span><span></span><span></span>`;
-              backItem.style.backgroundColor = itemCount % 2 === 0 ? '#f5f5f5' : '#fafafa';
-              fileListElement.appendChild(backItem);
-          }
-
-          // Add folders first, checking if they're empty
-          for (var i = 0; i < folders.length; i++) {
-            var folder = folders[i];
-            itemCount++;
-            var fileItem = document.createElement('li');
-            fileItem.classList.add('FSM_file-item');
-            
-            // Check folder access permissions
-            var deleteButton = '';
-            if (folder.access === 'r') {
-                deleteButton = '<button class="FSM_delete" disabled>Locked</button>';
-            } else {
-                // Enable delete button for empty folders
-                deleteButton = '<button class="FSM_delete" onclick="deleteFolder(\'' + folder.name + '\')">Delete</button>';
-            }
-            
-            // Format folder size as "n Files"
-            var folderSizeText = folder.size + (folder.size === 1 ? " File" : " Files");
-            
-            fileItem.innerHTML = `<span style="cursor: pointer" onclick="openFolder('${folder.name}')"><span class="FSM_folder-icon">${folderIcon}</span>${folder.name}</span><span class="FSM_size">${folderSizeText}</span><span></span>${deleteButton}`;
-            fileItem.style.backgroundColor = itemCount % 2 === 0 ? '#f5f5f5' : '#fafafa';
-            fileListElement.appendChild(fileItem);
-          }
-        
-          // Add files
-          for (var i = 0; i < files.length; i++) {
-              var file = files[i];
-              itemCount++;
-              var fileItem = document.createElement('li');
-              fileItem.classList.add('FSM_file-item');
-              
-              // Check file access permissions
-              var deleteButton = '';
-              if (file.access === 'r') {
-                  deleteButton = '<button class="FSM_delete" disabled>Locked</button>';
-              } else {
-                  deleteButton = '<button class="FSM_delete" onclick="deleteFile(\'' + file.name + '\')">Delete</button>';
-              }
-              
-              fileItem.innerHTML = `<span>${fileIcon}${file.name}</span><span class="FSM_size">${formatSize(file.size)}</span><button onclick="downloadFile('${file.name}')">Download</button>${deleteButton}`;
-              fileItem.style.backgroundColor = itemCount % 2 === 0 ? '#f5f5f5' : '#fafafa';
-              fileListElement.appendChild(fileItem);
-          }
-
-          headerElement.style.display = 'block';
-
-          // Update space information
-          var spaceInfo = document.getElementById('fsm_spaceInfo');
-          if (spaceInfo) {
-              var availableSpace = data.totalSpace - data.usedSpace;
-              spaceInfo.textContent = 'FileSystem uses ' + formatSize(data.usedSpace) + ' of ' + formatSize(data.totalSpace) + ' (' + formatSize(availableSpace) + ' available)';
-              spaceInfo.style.display = 'block';
-          } else {
-              console.error('fsm_spaceInfo element not found in DOM');
-          }
-          fileListElement.style.display = 'block';
+          listPaging = { path: currentFolder, data: data, loading: false };
+          var listElement = document.getElementById('fsm_fileList');
+          if (listElement) listElement.scrollTop = 0;
+          renderFileList(currentFolder, data);
       
       } else {
           console.error('Failed to load file list, status:', xhr.status);
@@ -359,6 +377,141 @@ if (spaceInfoElement) {
   xhr.send();
 }
 
+function renderFileList(path, data)
+{
+  var fileListElement = document.getElementById('fsm_fileList');
+  if (!fileListElement) {
+      console.error('fileList element not found in DOM');
+      return;
+  }
+  var scrollTop = fileListElement.scrollTop;  // Keep the position when a page is added
+  fileListElement.innerHTML = '';
+  
+  // Create or update the file list header to display the current folder name
+  var headerElement = document.querySelector('.FSM_file-list-header');
+  if (!headerElement) {
+      headerElement = document.createElement('div');
+      headerElement.className = 'FSM_file-list-header';
+      fileListElement.parentNode.insertBefore(headerElement, fileListElement);
+  }
+  
+  // Remove trailing '/' from folder name for display
+  var displayFolderName = currentFolder;
+  if (displayFolderName !== '/' && displayFolderName.endsWith('/')) {
+      displayFolderName = displayFolderName.slice(0, -1);
+  }
+  headerElement.textContent = displayFolderName;
+  //-- Initially hide the header when it is created
+  headerElement.style.display = 'none';
+  
+  // Create arrays for folders and files
+  // Remove duplicates by using a Map with folder name as key
+  var folderMap = new Map();
+  var files = [];
+  
+  for (var i = 0; i < data.files.length; i++) {
+      var file = data.files[i];
+      if (file.isDir) {
+          // Only add if not already in the map
+          if (!folderMap.has(file.name)) {
+              folderMap.set(file.name, file);
+          }
+      } else {
+          files.push(file);
+      }
+  }
+  
+  // Convert map back to array
+  var folders = Array.from(folderMap.values());
+
+  console.log('Found folders:', folders.length, 'files:', files.length);
+
+  // Sort folders and files alphabetically
+  files.sort(function(a, b) { return a.name.localeCompare(b.name); });
+  folders.sort(function(a, b) { return a.name.localeCompare(b.name); });
+
+  var itemCount = 0;
+
+  if (currentFolder !== '/') {
+      itemCount++;
+      var backItem = document.createElement('li');
+      backItem.classList.add('FSM_file-item');
+      backItem.innerHTML = `<span style="cursor: pointer" onclick="navigateUp()"><span class="FSM_folder-icon">${folderUpIcon}</span></span><span class="FSM_size"></span><span></span><span></span>`;
+      backItem.style.backgroundColor = itemCount % 2 === 0 ? '#f5f5f5' : '#fafafa';
+      fileListElement.appendChild(backItem);
+  }
+
+  // Add folders first, checking if they're empty
+  for (var i = 0; i < folders.length; i++) {
+    var folder = folders[i];
+    itemCount++;
+    var fileItem = document.createElement('li');
+    fileItem.classList.add('FSM_file-item');
+    
+    // Check folder access permissions
+    var deleteButton = '';
+    if (folder.access === 'r') {
+        deleteButton = '<button class="FSM_delete" disabled>Locked</button>';
+    } else {
+        // Folders are deleted together with their contents
+        deleteButton = '<button class="FSM_delete" onclick="deleteFolder(\'' + folder.name + '\')">Delete</button>';
+    }
+    
+    // Format folder size as "n Files"
+    var folderSizeText = folder.size + (folder.size === 1 ? " File" : " Files");
+    
+    fileItem.innerHTML = `<span style="cursor: pointer" onclick="openFolder('${folder.name}')"><span class="FSM_folder-icon">${folderIcon}</span>${folder.name}</span><span class="FSM_size">${folderSizeText}</span><span></span>${deleteButton}`;
+    fileItem.style.backgroundColor = itemCount % 2 === 0 ? '#f5f5f5' : '#fafafa';
+    fileListElement.appendChild(fileItem);
+  }
+
+  // Add files
+  for (var i = 0; i < files.length; i++) {
+      var file = files[i];
+      itemCount++;
+      var fileItem = document.createElement('li');
+      fileItem.classList.add('FSM_file-item');
+      
+      // Check file access permissions
+      var deleteButton = '';
+      if (file.access === 'r') {
+          deleteButton = '<button class="FSM_delete" disabled>Locked</button>';
+      } else {
+          deleteButton = '<button class="FSM_delete" onclick="deleteFile(\'' + file.name + '\')">Delete</button>';
+      }
+      
+      fileItem.innerHTML = `<span>${fileIcon}${displayName(file)}</span><span class="FSM_size">${formatSize(file.size)}</span><button onclick="downloadFile('${file.logicalName || file.name}')">Download</button>${deleteButton}`;
+      fileItem.style.backgroundColor = itemCount % 2 === 0 ? '#f5f5f5' : '#fafafa';
+      fileListElement.appendChild(fileItem);
+  }
+
+  headerElement.style.display = 'block';
+
+  if (data.nextCursor) {
+      itemCount++;
+      var moreItem = document.createElement('li');
+      moreItem.classList.add('FSM_file-item');
+      moreItem.innerHTML = `<span>${data.files.length} of ${data.total} shown</span><span class="FSM_size"></span><button onclick="loadMoreFiles()">Load more</button><span></span>`;
+      moreItem.style.backgroundColor = itemCount % 2 === 0 ? '#f5f5f5' : '#fafafa';
+      fileListElement.appendChild(moreItem);
+  }
+
+  // Update space information
+  var spaceInfo = document.getElementById('fsm_spaceInfo');
+  if (spaceInfo) {
+      var availableSpace = data.totalSpace - data.usedSpace;
+      spaceInfo.textContent = 'FileSystem uses ' + formatSize(data.usedSpace) + ' of ' + formatSize(data.totalSpace) + ' (' + formatSize(availableSpace) + ' available)';
+      spaceInfo.style.display = 'block';
+  } else {
+      console.error('fsm_spaceInfo element not found in DOM');
+  }
+  fileListElement.style.display = 'block';
+  fileListElement.scrollTop = scrollTop;
+  fileListElement.onscroll = function() { loadMoreIfAtEnd(fileListElement); };
+  loadMoreIfAtEnd(fileListElement);
+
+} // renderFileList()
+
 /***************************************/
 
 function navigateUp() {
@@ -412,54 +565,42 @@ function openFolder(folderName) {
 
 function deleteFolder(folderName) {
     console.log('Attempting to delete folder:', folderName);
-    // Check if folder is empty
-    var checkXhr = new XMLHttpRequest();
-    checkXhr.open('GET', '/fsm/filelist?folder=' + currentFolder + folderName + '/', true);
-    
-    checkXhr.onload = function() {
-        if (checkXhr.status === 200) {
-            var data = JSON.parse(checkXhr.responseText);
-            
-            if (data.files && data.files.length > 0) {
-                console.error('Cannot delete folder: Folder is not empty');
-                return;
-            }
+    if (!confirm('Are you sure you want to delete the folder "' + folderName + '" and everything in it?')) return;
 
-            if (!confirm('Are you sure you want to delete the folder "' + folderName + '"?')) return;
+    sendFolderDelete(currentFolder + folderName);
+}
 
-            console.log('Sending delete folder request');
-            var deleteXhr = new XMLHttpRequest();
-            deleteXhr.open('POST', '/fsm/deleteFolder', true);
-            deleteXhr.setRequestHeader('Content-Type', 'application/x-www-form-urlencoded');
-            
-            deleteXhr.onload = function() {
-                if (deleteXhr.status === 200) {
-                    console.log('Folder deleted successfully');
-                    
-                    // Set the reset state to ignore the currentFolder from the server
-                    isResettingToRoot = true;
-                    
-                    loadFileList();
-                } else {
-                    console.error('Failed to delete folder, status:', deleteXhr.status);
-                }
-            };
-            
-            deleteXhr.onerror = function() {
-                console.error('Failed to delete folder');
-            };
-            
-            deleteXhr.send('folder=' + encodeURIComponent(folderName));
+// The device removes the folder and its contents; a large folder may take
+// several requests, the answer is 202 while there is more to remove
+function sendFolderDelete(folderPath) {
+    console.log('Sending delete folder request');
+    var deleteXhr = new XMLHttpRequest();
+    deleteXhr.open('POST', '/fsm/deleteFolder', true);
+    deleteXhr.setRequestHeader('Content-Type', 'application/x-www-form-urlencoded');
+    
+    deleteXhr.onload = function() {
+        if (deleteXhr.status === 202) {
+            console.log('Folder partly deleted, sending again');
+            sendFolderDelete(folderPath);
+            return;
+        }
+        if (deleteXhr.status === 200) {
+            console.log('Folder deleted successfully');
         } else {
-            console.error('Failed to check if folder is empty, status:', checkXhr.status);
+            console.error('Failed to delete folder, status:', deleteXhr.status, deleteXhr.responseText);
         }
+        
+        // Set the reset state to ignore the currentFolder from the server
+        isResettingToRoot = true;
+        
+        loadFileList();
     };
     
-    checkXhr.onerror = function() {
-        console.error('Failed to check folder');
+    deleteXhr.onerror = function() {
+        console.error('Failed to delete folder');
     };
     
-    checkXhr.send();
+    deleteXhr.send('folder=' + encodeURIComponent(folderPath) + '&recursive=1');
 }
 
 function downloadFile(fileName) {
@@ -28,21 +28,121 @@ function showStatus(message, isError = false) {
   setTimeout(() => statusDiv.style.display = 'none', 3000);
 }
 
+// Opt-in: store text assets gzip-compressed on the device (needs CompressionStream)
+const gzipTextUploads = false;
+
+// Upload .tar / .tar.gz files as archives that are extracted into the current folder
+const extractArchives = true;
+
+function uploadQuery(upload) {
+  if (upload.extract) return '?extract=tar';
+  return upload.compressed ? '?compressed=gzip' : '';
+}
+
+// Text shown after an upload, the device answers with a JSON report
+function uploadResultText(text) {
+  try {
+    const report = JSON.parse(text);
+    if (report.entries) return `Archive extracted: ${report.extracted} entries, ${report.skipped} skipped`;
+    if (report.files) {
+      if (report.success) return `${report.uploaded} file(s) uploaded`;
+      const failures = report.files.filter(file => file.status !== 200).map(file => `${file.name}: ${file.message}`);
+      return `${report.uploaded} uploaded, ${report.failed} failed (${failures.join('; ') || report.error})`;
+    }
+  } catch (e) {
+    // Plain text answer
+  }
+  return text;
+}
+
+// Folders are listed in pages, the next page is loaded when the list is scrolled to its end
+const listPageSize = 100;
+let listPaging = null;
+
+function listPageUrl(path, cursor) {
+  let url = '/fsm/filelist?folder=' + encodeURIComponent(path) + '&limit=' + listPageSize;
+  if (cursor) url += '&cursor=' + encodeURIComponent(cursor);
+  return url;
+}
+
+function loadMoreFiles() {
+  if (!listPaging || listPaging.loading || !listPaging.data.nextCursor) return;
+  listPaging.loading = true;
+  fetch(listPageUrl(listPaging.path, listPaging.data.nextCursor))
+    .then(response => {
+      if (response.status === 409) {
+        // The folder changed since the first page, start over
+        listPaging = null;
+        loadFileList();
+        return null;
+      }
+      if (!response.ok) throw new Error(`HTTP error! status: ${response.status}`);
+      return response.json();
+    })
+    .then(page => {
+      if (!page || !listPaging) return;
+      listPaging.data.files = listPaging.data.files.concat(page.files);
+      listPaging.data.nextCursor = page.nextCursor;
+      listPaging.loading = false;
+      renderFileList(listPaging.path, listPaging.data);
+    })
+    .catch(error => {
+      if (listPaging) listPaging.loading = false;
+      showStatus('Failed to load more files: ' + error, true);
+    });
+}
+
+// scroller is the scrolling list element, or null when the page itself scrolls
+function loadMoreIfAtEnd(scroller) {
+  const atEnd = scroller
+    ? scroller.scrollTop + scroller.clientHeight >= scroller.scrollHeight - 100
+    : window.innerHeight + window.scrollY >= document.body.offsetHeight - 100;
+  if (atEnd) loadMoreFiles();
+}
+
+function prepareUpload(file) {
+  // Archives are unpacked on the device, a .tar.gz is inflated here first
+  if (extractArchives && /\.(tar|tar\.gz|tgz)$/i.test(file.name)) {
+    if (/\.tar$/i.test(file.name)) {
+      return Promise.resolve({ blob: file, compressed: false, extract: true });
+    }
+    if (typeof DecompressionStream === 'undefined') {
+      return Promise.reject(new Error('This browser cannot unpack .tar.gz, upload a .tar'));
+    }
+    return new Response(file.stream().pipeThrough(new DecompressionStream('gzip'))).blob()
+      .then(blob => ({ blob: blob, compressed: false, extract: true }));
+  }
+  const isText = /\.(html?|css|js|json|svg|txt|csv|xml)$/i.test(file.name);
+  if (!gzipTextUploads || !isText || typeof CompressionStream === 'undefined') {
+    return Promise.resolve({ blob: file, compressed: false });
+  }
+  return new Response(file.stream().pipeThrough(new CompressionStream('gzip'))).blob()
+    .then(blob => ({ blob: blob, compressed: true }));
+}
+
+// Name shown for a file, precompressed assets show their logical name and ratio
+function displayName(file) {
+  if (!file.logicalName || !file.originalSize) return file.name;
+  const ratio = Math.round((file.size / file.originalSize) * 100);
+  return `${file.logicalName} (gz ${ratio}%)`;
+}
+
 function handleUpload(event) {
   event.preventDefault();
   const form = event.target;
   const fileInput = form.querySelector('input[type="file"]');
-  const file = fileInput.files[0];
+  const files = Array.from(fileInput.files);
   
-  if (!file) {
+  if (files.length === 0) {
     showStatus('Please select a file', true);
     return;
   }
   
-  console.log("Selected file:", file.name, "Size:", file.size, "bytes");
+  const totalSize = files.reduce((sum, file) => sum + file.size, 0);
+  console.log("Selected files:", files.length, "Size:", totalSize, "bytes");
   
-  // Check if there's enough space before uploading
-  fetch('/fsm/checkSpace?size=' + file.size)
+  // Check once if there's enough space for all files before uploading
+  fetch('/fsm/checkSpace?size=' + totalSize)
     .then(response => {
       if (!response.ok) {
         return response.text().then(text => {
@@ -51,28 +151,39 @@ function handleUpload(event) {
       }
       return response.text();
     })
-    .then(() => {
-      // If we get here, there's enough space, proceed with upload
-      const formData = new FormData(form);
-      
-      // Add current folder to formData
+    .then(() => Promise.all(files.map(prepareUpload)))
+    .then(uploads => {
+      // Plain files go to the device in one request and compressed files in
+      // another (marked with ?compressed=gzip, which both server backends
+      // see), archives that are extracted get a request of their own
+      const requests = [];
+      const formData = new FormData();
+      const gzipData = new FormData();
       formData.append('folder', currentFolder);
-      
-      return fetch(form.action, {
-        method: 'POST',
-        body: formData
+      gzipData.append('folder', currentFolder);
+      uploads.forEach((upload, i) => {
+        if (upload.extract) {
+          const archiveData = new FormData();
+          archiveData.append('folder', currentFolder);
+          archiveData.append('file', upload.blob, files[i].name);
+          requests.push({ query: uploadQuery(upload), body: archiveData });
+        } else {
+          (upload.compressed ? gzipData : formData).append('file', upload.blob, files[i].name);
+        }
       });
+      if (uploads.some(upload => !upload.extract && upload.compressed)) requests.unshift({ query: '?compressed=gzip', body: gzipData });
+      if (uploads.some(upload => !upload.extract && !upload.compressed)) requests.unshift({ query: '', body: formData });
+
+      // One request after the other, the device receives one upload at a time
+      return requests.reduce((chain, request) => chain.then(results =>
+        fetch(form.action + request.query, { method: 'POST', body: request.body })
+          .then(response => response.text().then(text => {
+            if (!response.ok) throw new Error(uploadResultText(text) || 'Upload failed');
+            return results.concat(uploadResultText(text));
+          }))), Promise.resolve([]));
     })
-    .then(response => {
-      if (!response.ok) {
-        return response.text().then(text => {
-          throw new Error(text || 'Upload failed');
-        });
-      }
-      return response.text();
-    })
-    .then(result => {
-      showStatus(result);
+    .then(results => {
+      showStatus(results.join(', '));
       form.reset();
       loadFileList();
     })
@@ -112,7 +223,7 @@ function loadFileList(path = currentFolder) {
     if (folderInput) folderInput.disabled = true;
   }
 
-  fetch('/fsm/filelist?folder=' + encodeURIComponent(path))
+  fetch(listPageUrl(path))
     .then(response => {
       if (!response.ok) {
         if (response.status === 400) {
@@ -130,60 +241,82 @@ function loadFileList(path = currentFolder) {
       if (!data || !Array.isArray(data.files)) {
         throw new Error('Invalid response format');
       }
-      fileListElement.innerHTML = '';
+      listPaging = { path: path, data: data, loading: false };
+      document.getElementById('fsm_fileList').scrollTop = 0;
+      renderFileList(path, data);
+    })
+    .catch(error => showStatus('Failed to load file list: ' + error, true));
 
-      var displayFolderName = path;
-      if (displayFolderName !== '/' && displayFolderName.endsWith('/')) {
-        displayFolderName = displayFolderName.slice(0, -1);
-      }
-      headerElement.textContent = displayFolderName;
-      headerElement.style.display = 'block';
-
-      var folders = data.files.filter(file => file.isDir);
-      var files = data.files.filter(file => !file.isDir);
-      folders.sort((a, b) => a.name.localeCompare(b.name));
-      files.sort((a, b) => a.name.localeCompare(b.name));
-
-      if (path !== '/') {
-        var backItem = document.createElement('li');
-        backItem.classList.add('FSM_file-item');
-        backItem.innerHTML = `<span style="cursor: pointer" onclick="navigateToFolder('${getParentFolder(path)}')">${folderUpIcon}</span>`;
-        fileListElement.appendChild(backItem);
-      }
+} // loadFileList()
 
-      folders.forEach(folder => {
-        var folderItem = document.createElement('li');
-        folderItem.classList.add('FSM_file-item');
-        folderItem.innerHTML = `<span style="cursor: pointer" onclick="navigateToFolder('${path + '/' + folder.name}')">${folderIcon} ${folder.name}</span>`;
-        folderItem.innerHTML += `<span> </span>`;
-        if (folder.access === "r") 
-              folderItem.innerHTML += `<span><button class="button" disabled style="background-color: #cccccc; cursor: not-allowed;">Locked</button></span>`; 
-        else  folderItem.innerHTML += `<span><button class="button FSM_delete" onclick="deleteFolder('${folder.name}')">Delete</button></span>`;
-        fileListElement.appendChild(folderItem);
-      });
-      console.log("processed all folders ..");
-
-      files.forEach(file => {
-        console.log('File:', file);
-        var fileItem = document.createElement('li');
-        fileItem.classList.add('FSM_file-item');
-        fileItem.innerHTML = `<span>${fileIcon} ${file.name}</span><span><button onclick="downloadFile('${file.name}')">Download</button></span>`;
-        if (file.access === "r") 
-              fileItem.innerHTML += `<span><button class="button" disabled style="background-color: #cccccc; cursor: not-allowed;">Locked</button></span>`; 
-        else  fileItem.innerHTML += `<span><button class="button FSM_delete" onclick="deleteFile('${file.name}')">Delete</button></span>`;
-        fileListElement.appendChild(fileItem);
-      });
-      console.log("processed all files ..");
 
-      spaceInfoElement.innerHTML = `Storage: ${formatBytes(data.usedSpace)} used of ${formatBytes(data.totalSpace)} (${formatBytes(data.totalSpace - data.usedSpace)} available)`;
-      spaceInfoElement.style.display = 'block';
-      fileListElement.style.display = 'block';
-      if (contentElement) contentElement.style.display = 'block';
+function renderFileList(path, data) {
+  var contentElement = document.querySelector('.FSM_content-wrapper');
+  var headerElement = document.querySelector('.FSM_file-list-header');
+  var fileListElement = document.getElementById('fsm_fileList');
+  var spaceInfoElement = document.getElementById('fsm_spaceInfo');
+  var scrollTop = fileListElement.scrollTop;  // Keep the position when a page is added
+  fileListElement.innerHTML = '';
+
+  var displayFolderName = path;
+  if (displayFolderName !== '/' && displayFolderName.endsWith('/')) {
+    displayFolderName = displayFolderName.slice(0, -1);
+  }
+  headerElement.textContent = displayFolderName;
+  headerElement.style.display = 'block';
+
+  var folders = data.files.filter(file => file.isDir);
+  var files = data.files.filter(file => !file.isDir);
+  folders.sort((a, b) => a.name.localeCompare(b.name));
+  files.sort((a, b) => a.name.localeCompare(b.name));
+
+  if (path !== '/') {
+    var backItem = document.createElement('li');
+    backItem.classList.add('FSM_file-item');
+    backItem.innerHTML = `<span style="cursor: pointer" onclick="navigateToFolder('${getParentFolder(path)}')">${folderUpIcon}</span>`;
+    fileListElement.appendChild(backItem);
+  }
 
-    })
-    .catch(error => showStatus('Failed to load file list: ' + error, true));
+  folders.forEach(folder => {
+    var folderItem = document.createElement('li');
+    folderItem.classList.add('FSM_file-item');
+    folderItem.innerHTML = `<span style="cursor: pointer" onclick="navigateToFolder('${path + '/' + folder.name}')">${folderIcon} ${folder.name}</span>`;
+    folderItem.innerHTML += `<span> </span>`;
+    if (folder.access === "r") 
+          folderItem.innerHTML += `<span><button class="button" disabled style="background-color: #cccccc; cursor: not-allowed;">Locked</button></span>`; 
+    else  folderItem.innerHTML += `<span><button class="button FSM_delete" onclick="deleteFolder('${folder.name}')">Delete</button></span>`;
+    fileListElement.appendChild(folderItem);
+  });
+  console.log("processed all folders ..");
+
+  files.forEach(file => {
+    console.log('File:', file);
+    var fileItem = document.createElement('li');
+    fileItem.classList.add('FSM_file-item');
+    fileItem.innerHTML = `<span>${fileIcon} ${displayName(file)}</span><span><button onclick="downloadFile('${file.logicalName || file.name}')">Download</button></span>`;
+    if (file.access === "r") 
+          fileItem.innerHTML += `<span><button class="button" disabled style="background-color: #cccccc; cursor: not-allowed;">Locked</button></span>`; 
+    else  fileItem.innerHTML += `<span><button class="button FSM_delete" onclick="deleteFile('${file.name}')">Delete</button></span>`;
+    fileListElement.appendChild(fileItem);
+  });
+  console.log("processed all files ..");
+
+  if (data.nextCursor) {
+    var moreItem = document.createElement('li');
+    moreItem.classList.add('FSM_file-item');
+    moreItem.innerHTML = `<span>${data.files.length} of ${data.total} shown</span><span><button onclick="loadMoreFiles()">Load more</button></span>`;
+    fileListElement.appendChild(moreItem);
+  }
 
-} // loadFileList()
+  spaceInfoElement.innerHTML = `Storage: ${formatBytes(data.usedSpace)} used of ${formatBytes(data.totalSpace)} (${formatBytes(data.totalSpace - data.usedSpace)} available)`;
+  spaceInfoElement.style.display = 'block';
+  fileListElement.style.display = 'block';
+  if (contentElement) contentElement.style.display = 'block';
+  fileListElement.scrollTop = scrollTop;
+  fileListElement.onscroll = () => loadMoreIfAtEnd(fileListElement);
+  loadMoreIfAtEnd(fileListElement);
+
+} // renderFileList()
 
 
 function downloadFile(filename) {
@@ -237,22 +370,29 @@ function createFolder() {
 }
 
 function deleteFolder(foldername) {
-  if (!confirm('Are you sure you want to delete folder ' + foldername + '?')) return;
+  if (!confirm('Are you sure you want to delete folder ' + foldername + ' and everything in it?')) return;
 
   const fullPath = currentFolder + (currentFolder.endsWith('/') ? '' : '/') + foldername;
+  sendFolderDelete(fullPath);
+}
+
+// A large folder may take several requests: the device answers 202 while
+// there is more to remove
+function sendFolderDelete(fullPath) {
   fetch('/fsm/deleteFolder', {
     method: 'POST',
     headers: {'Content-Type': 'application/x-www-form-urlencoded'},
-    body: 'folder=' + encodeURIComponent(fullPath)
+    body: 'folder=' + encodeURIComponent(fullPath) + '&recursive=1'
   })
-  .then(response => response.text())
-  .then(result => {
+  .then(response => response.text().then(result => {
     showStatus(result);
-    if (result.includes('deleted')) {
+    if (response.status === 202) {
+      sendFolderDelete(fullPath);
+    } else if (result.includes('deleted')) {
       document.getElementById('fsm_foldername').value = '';
       loadFileList();
     }
-  })
+  }))
   .catch(error => showStatus('Failed to delete folder: ' + error, true));
 }
 
@@ -0,0 +1,66 @@
+#include <Arduino.h>
+
+// Build with -DFSMANAGER_ASYNC=1 (see the esp32async and esp8266async
+// environments), FSmanager then registers its endpoints with the
+// AsyncWebServer and loop() is free for the application
+#ifdef ESP32
+  #include <WiFi.h>
+  #include <AsyncTCP.h>
+#else
+  #include <ESP8266WiFi.h>
+  #include <ESPAsyncTCP.h>
+#endif
+#include <ESPAsyncWebServer.h>
+#include <LittleFS.h>
+#include "FSmanager.h"
+
+AsyncWebServer server(80);
+FSmanager fsManager(server);
+
+uint32_t lastSample = 0;
+uint32_t samples = 0;
+
+
+void setup()
+{
+    Serial.begin(115200);
+    delay(4000);
+
+    // WiFiManager needs the synchronous WebServer, this example connects
+    // with the credentials the ESP stored on an earlier connection
+    WiFi.mode(WIFI_STA);
+    WiFi.begin();
+    while (WiFi.status() != WL_CONNECTED)
+    {
+      delay(500);
+      Serial.print(".");
+    }
+    Serial.printf("\nConnected, IP address: %s\n", WiFi.localIP().toString().c_str());
+
+    LittleFS.begin();
+
+    fsManager.begin(&Serial);
+    fsManager.addSystemFile("/favicon.ico");
+
+    fsManager.setSystemFilePath("/basicFSM");
+    fsManager.addSystemFile(fsManager.getSystemFilePath() + "/basicFSM.html");
+    fsManager.addSystemFile(fsManager.getSystemFilePath() + "/basicFSM.js");
+
+    server.on("/", HTTP_GET, [](AsyncWebServerRequest* request) {
+        request->send(LittleFS, "/basicFSM/basicFSM.html", "text/html");
+    });
+    server.begin();
+    Serial.println("Webserver started!");
+}
+
+void loop()
+{
+    // Requests are handled by the async server, a long download or upload
+    // does not hold up this loop
+    if (millis() - lastSample >= 100)
+    {
+      lastSample = millis();
+      if (++samples % 600 == 0) Serial.printf("%u samples taken\n", (unsigned)samples);
+    }
+    fsManager.drainLog();
+}
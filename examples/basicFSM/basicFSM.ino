@@ -127,4 +127,5 @@ void setup()
 void loop()
 {
     server.handleClient();
+    fsManager.drainLog();
 }
@@ -303,7 +303,7 @@ void setupFSmanagerPage()
   const char *popupUploadFile = R"HTML(
     <div id="popUpUploadFile">Upload File</div>
     <div id="fsm_fileUpload">
-      <input type="file" id="fsm_fileInput">
+      <input type="file" id="fsm_fileInput" multiple>
       <div id="selectedFileName" style="margin-top: 5px; font-style: italic;"></div>
     </div>
     <div style="margin-top: 10px;">
@@ -431,6 +431,7 @@ void loop()
 {
   network->loop();
   spaManager.server.handleClient();
+  fsManager.drainLog();
   spaManager.ws.loop();
   updateCounter();
 }
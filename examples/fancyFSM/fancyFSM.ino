@@ -143,4 +143,5 @@ void setup()
 void loop()
 {
     server.handleClient();
+    fsManager.drainLog();
 }
@@ -0,0 +1,30 @@
+Import("env")
+import os
+import subprocess
+
+# Print the flash and RAM use of every firmware that is built and keep the
+# last result per environment in size_report.txt, so the FSMANAGER_ENABLE_*
+# configurations can be compared side by side
+
+REPORT_FILE = os.path.join(env.subst("$PROJECT_BUILD_DIR"), "size_report.txt")
+
+def report_size(source, target, env):
+    elf_file = str(source[0])
+    output = subprocess.check_output([env.subst("$SIZETOOL"), "-B", "-d", elf_file]).decode()
+    text, data, bss = [int(value) for value in output.splitlines()[1].split()[:3]]
+    line = "%-20s flash %8d  ram %7d  (text %d, data %d, bss %d)" % (env["PIOENV"], text + data, data + bss, text, data, bss)
+    print("FSmanager size: " + line)
+
+    # One line per environment, the newest result replaces the old one
+    lines = {}
+    if os.path.exists(REPORT_FILE):
+        with open(REPORT_FILE) as report:
+            for old_line in report:
+                if old_line.strip():
+                    lines[old_line.split()[0]] = old_line.rstrip("\n")
+    lines[env["PIOENV"]] = line
+    with open(REPORT_FILE, "w") as report:
+        for name in sorted(lines):
+            report.write(lines[name] + "\n")
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report_size)
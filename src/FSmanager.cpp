@@ -1,12 +1,220 @@
 // FSmanager.cpp
 #include "FSmanager.h"
-#include <map>
+#include <algorithm>
+#include <memory>
+#include <stdarg.h>
+
+// Statement that only exists in builds with statistics
+#if FSMANAGER_STATS
+  #define FSM_STAT(statement) statement
+#else
+  #define FSM_STAT(statement)
+#endif
+
+// Leveled logging, a disabled level is type checked but generates no code
+#define FSM_LOG_AT(level, ...) do { if (FSMANAGER_LOG_LEVEL >= (level)) logLine(__VA_ARGS__); } while (0)
+#define FSM_LOG_E(...) FSM_LOG_AT(FSMANAGER_LOG_ERROR, __VA_ARGS__)
+#define FSM_LOG_W(...) FSM_LOG_AT(FSMANAGER_LOG_WARN, __VA_ARGS__)
+#define FSM_LOG_I(...) FSM_LOG_AT(FSMANAGER_LOG_INFO, __VA_ARGS__)
+#define FSM_LOG_D(...) FSM_LOG_AT(FSMANAGER_LOG_DEBUG, __VA_ARGS__)
+
+// Async handlers run in the network task, where yield() is not allowed
+// on ESP8266 and would only hold up the other connections on ESP32
+#if FSMANAGER_ASYNC
+  #define FSM_YIELD()
+#else
+  #define FSM_YIELD() yield()
+#endif
+
+//=====================================================================
+// FSPath
+//=====================================================================
+
+FSPath::FSPath()
+{
+  clear();
+}
+
+
+void FSPath::clear()
+{
+  buf[0] = '\0';
+  len = 0;
+
+} // clear()
+
+
+bool FSPath::fail()
+{
+  clear();
+  return false;
+
+} // fail()
+
+
+bool FSPath::set(const char* path, bool asFolder)
+{
+  buf[0] = '/';
+  buf[1] = '\0';
+  len = 1;
+  return append(path, asFolder);
+
+} // set()
+
+
+bool FSPath::append(const char* relative, bool asFolder)
+{
+  if (len == 0) return false;
+  if (relative == nullptr) relative = "";
+
+  // Components are copied in one pass and checked when their end is reached
+  if (buf[len - 1] != '/')
+  {
+    if (len + 1 >= sizeof(buf)) return fail();
+    buf[len++] = '/';
+  }
+  size_t start = len;
+  for (const char* p = relative; ; p++)
+  {
+    char c = *p;
+    if (c == '/' || c == '\0')
+    {
+      size_t nameLen = len - start;
+      if (nameLen == 1 && buf[start] == '.')
+      {
+        len = start;  // "." adds nothing
+      }
+      else if (nameLen == 2 && buf[start] == '.' && buf[start + 1] == '.')
+      {
+        return fail();  // No way out of the folder
+      }
+      else if (nameLen > FSMANAGER_MAX_NAME)
+      {
+        return fail();
+      }
+      else if (nameLen > 0 && c == '/')
+      {
+        if (len + 1 >= sizeof(buf)) return fail();
+        buf[len++] = '/';
+      }
+      if (c == '\0') break;
+      start = len;
+      continue;
+    }
+    if ((unsigned char)c < 0x20 || len + 1 >= sizeof(buf)) return fail();
+    buf[len++] = c;
+  }
+
+  if (asFolder && buf[len - 1] != '/')
+  {
+    if (len + 1 >= sizeof(buf)) return fail();
+    buf[len++] = '/';
+  }
+  else if (!asFolder && len > 1 && buf[len - 1] == '/')
+  {
+    len--;
+  }
+  buf[len] = '\0';
+  return true;
+
+} // append()
+
+
+bool FSPath::appendSuffix(const char* suffix)
+{
+  // Extends the last name, e.g. ".gz" or ".part"
+  if (len <= 1 || isFolder()) return false;
+  size_t suffixLen = strlen(suffix);
+  if (strlen(name()) + suffixLen > FSMANAGER_MAX_NAME || len + suffixLen >= sizeof(buf)) return false;
+  memcpy(buf + len, suffix, suffixLen + 1);
+  len += suffixLen;
+  return true;
+
+} // appendSuffix()
+
+
+void FSPath::toParent()
+{
+  // "/a/b/c" and "/a/b/c/" both become "/a/b/"
+  if (len <= 1) return;
+  if (buf[len - 1] == '/') len--;
+  while (len > 1 && buf[len - 1] != '/') len--;
+  buf[len] = '\0';
+
+} // toParent()
+
+
+bool FSPath::endsWith(const char* suffix) const
+{
+  size_t suffixLen = strlen(suffix);
+  return (len >= suffixLen) && (memcmp(buf + len - suffixLen, suffix, suffixLen) == 0);
+
+} // endsWith()
+
+
+const char* FSPath::name() const
+{
+  // Last component of a file path, empty for a folder
+  const char* slash = strrchr(buf, '/');
+  return (slash != nullptr) ? slash + 1 : buf;
+
+} // name()
+
+
+int FSPath::depth() const
+{
+  // Number of components: "/" = 0, "/a/" = 1, "/a/b" = 2
+  int count = 0;
+  for (size_t i = 0; i < len; i++) if (buf[i] == '/') count++;
+  return isFolder() ? count - 1 : count;
+
+} // depth()
+
+
+//=====================================================================
+// FSmanager
+//=====================================================================
 
 FSmanager::FSmanager(WebServerClass &srv)
 {
+    webServer = &srv;
+#if FSMANAGER_ASYNC
+    server = nullptr;
+#else
     server = &srv;
-    currentFolder = "/";
+#endif
+    clientTick = 0;
     debugPort = &Serial;
+    chunkLength = 0;
+    chunkCapture = nullptr;
+#if FSMANAGER_ASYNC
+    chunkSink = nullptr;
+#endif
+    listGeneration = 0;
+#ifdef ESP32
+    bootNonce = esp_random();
+#else
+    bootNonce = RANDOM_REG32;
+#endif
+    listCacheTick = 0;
+    invalidationHolds = 0;
+    invalidationPending = false;
+    trackedUsedSpace = 0;
+    spaceBlockSize = 1;
+    fsBlockSize = FSMANAGER_FS_BLOCK_SIZE;
+    spaceResyncInterval = 0;
+    lastSpaceResync = 0;
+#if FSMANAGER_HAS_UPLOADS
+    uploadCtx = nullptr;
+    refusedConnection = 0;
+    uploadBufferSize = FSMANAGER_UPLOAD_BUFFER_SIZE;
+#endif
+#if FSMANAGER_LOG_BUFFER_SIZE > 0
+    logHead = 0;
+    logTail = 0;
+#endif
+    logDropped = 0;
+    resetStats();
 }
 
 std::string FSmanager::formatSize(size_t bytes)
@@ -28,67 +236,186 @@ std::string FSmanager::formatSize(size_t bytes)
 }
 
 
-void FSmanager::setSystemFilePath(const std::string &path)
+void FSmanager::beginChunkedResponse(int code, const char* contentType)
+{
+  // Send headers only, the body follows in chunks (Transfer-Encoding: chunked)
+  chunkLength = 0;
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(code, contentType, "");
+
+} // beginChunkedResponse()
+
+
+void FSmanager::sendChunk(const char* text)
+{
+  sendChunk(text, strlen(text));
+
+} // sendChunk()
+
+
+void FSmanager::sendChunk(const char* text, size_t len)
 {
-  std::string tmpPath = path;
-  // Ensure it starts with '/' but does not end with '/'
-  if (!tmpPath.empty() && tmpPath.front() != '/') {
-    tmpPath = "/" + tmpPath;  // Add '/' at the beginning if not already present
+#if FSMANAGER_ASYNC
+  // Text of a response the server pulls, see readList()
+  if (chunkSink != nullptr)
+  {
+    chunkSink->append(text, len);
+    return;
+  }
+#endif
+  if (chunkCapture != nullptr)
+  {
+    // Stop capturing when the response outgrows the cache limit
+    if (chunkCapture->length() + len > FSMANAGER_LIST_CACHE_MAX_BYTES)
+    {
+      chunkCapture->clear();
+      chunkCapture->shrink_to_fit();
+      chunkCapture = nullptr;
+    }
+    else
+    {
+      chunkCapture->append(text, len);
+    }
   }
 
-  if (tmpPath != "/" && tmpPath.back() == '/') {
-    tmpPath.pop_back();  // Remove trailing '/' if it's not the root '/'
+  while (len > 0)
+  {
+    size_t room = sizeof(chunkBuffer) - chunkLength;
+    size_t part = (len < room) ? len : room;
+    memcpy(chunkBuffer + chunkLength, text, part);
+    chunkLength += part;
+    text        += part;
+    len         -= part;
+    if (chunkLength == sizeof(chunkBuffer)) flushChunk();
   }
 
-  systemPath = tmpPath;
+} // sendChunk()
 
-  debugPort->printf("FSmanager::setSystemFilePath(): systemPath set to: [%s]\n", systemPath.c_str());
 
-} // setSystemFilePath()
+void FSmanager::flushChunk()
+{
+  if (chunkLength == 0) return;
+  server->sendContent(chunkBuffer, chunkLength);
+  FSM_STAT(statBytesOut += chunkLength);
+  chunkLength = 0;
+
+} // flushChunk()
+
+
+void FSmanager::endChunkedResponse()
+{
+  flushChunk();
+  server->sendContent("");  // Zero-length chunk terminates the response
+
+} // endChunkedResponse()
 
 
-void FSmanager::addSystemFile(const std::string &fullPath, bool setServe)
+void FSmanager::sendListEntry(const char* name, bool isDir, size_t size, bool isReadOnly, bool &first, size_t originalSize)
 {
-  std::string sanitizedPath = fullPath;
-  std::string fullName;
+  char numBuf[24];
 
-  if (doDebug) debugPort->printf("FSmanager::addSystemFile(): Adding system file: [%s]\n", sanitizedPath.c_str());
+  if (!first) sendChunk(",");
+  first = false;
 
-  // Ensure sanitizedPath starts with '/'
-  if (!sanitizedPath.empty() && sanitizedPath[0] != '/')
+  sendChunk("{\"name\":\"");
+  sendChunk(name);
+  sendChunk(isDir ? "\",\"isDir\":true,\"size\":" : "\",\"isDir\":false,\"size\":");
+  snprintf(numBuf, sizeof(numBuf), "%u", (unsigned)size);
+  sendChunk(numBuf);
+  sendChunk(isReadOnly ? ",\"access\":\"r\"" : ",\"access\":\"w\"");
+  if (originalSize > 0)
   {
-    sanitizedPath.insert(0, 1, '/');
+    // Precompressed asset: logical name and uncompressed size
+    size_t nameLen = strlen(name);
+    snprintf(numBuf, sizeof(numBuf), "%u", (unsigned)originalSize);
+    sendChunk(",\"logicalName\":\"");
+    sendChunk(name, (nameLen > 3) ? nameLen - 3 : 0);
+    sendChunk("\",\"originalSize\":");
+    sendChunk(numBuf);
   }
+  sendChunk("}");
 
-  // Replace double slashes '//' with single '/'
-  for (size_t pos = 0; (pos = sanitizedPath.find("//", pos)) != std::string::npos; )
+} // sendListEntry()
+
+
+static uint32_t hashPath(const char* path, size_t len)
+{
+  // FNV-1a, the same hash isSystemFile() builds up character by character
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++)
   {
-    sanitizedPath.erase(pos, 1);
+    hash ^= (uint8_t)path[i];
+    hash *= 16777619u;
   }
+  return hash;
+
+} // hashPath()
+
+
+static void insertSorted(std::vector<uint32_t> &hashes, uint32_t hash)
+{
+  // Kept sorted for the binary search in isSystemFile() whenever it is
+  // called, before or after begin(). Grows one entry at a time: the lists
+  // are short and built once, so this leaves no slack to trim.
+  auto pos = std::lower_bound(hashes.begin(), hashes.end(), hash);
+  if (pos != hashes.end() && *pos == hash) return;
+  size_t at = pos - hashes.begin();
+  hashes.reserve(hashes.size() + 1);
+  hashes.insert(hashes.begin() + at, hash);
+
+} // insertSorted()
 
-  // Ensure sanitizedPath never ends in '/'
-  if (sanitizedPath.length() > 1 && sanitizedPath.back() == '/')
+
+void FSmanager::setSystemFilePath(const std::string &path)
+{
+  // Starts with '/' but does not end with '/'
+  FSPath canonical;
+  if (!canonical.set(path.c_str()))
   {
-    sanitizedPath.pop_back();
+    FSM_LOG_W("FSmanager::setSystemFilePath(): invalid path [%s]", path.c_str());
+    return;
   }
+  systemPath = canonical.c_str();
+
+  FSM_LOG_I("FSmanager::setSystemFilePath(): systemPath set to: [%s]", systemPath.c_str());
+
+} // setSystemFilePath()
+
 
-  std::string fName = sanitizedPath.substr(sanitizedPath.find_last_of('/') + 1); // Extract filename
-  // Ensure fName starts with '/'
-  if (!fName.empty() && fName[0] != '/')
+void FSmanager::addSystemFile(const std::string &fullPath, bool setServe, const std::string &cacheControl)
+{
+  FSM_LOG_D("FSmanager::addSystemFile(): Adding system file: [%s]", fullPath.c_str());
+
+  // Canonical path, never ends in '/'
+  FSPath sanitizedPath;
+  if (!sanitizedPath.set(fullPath.c_str()) || sanitizedPath.isRoot())
   {
-    fName.insert(0, 1, '/');
+    FSM_LOG_W("FSmanager::addSystemFile(): invalid path [%s]", fullPath.c_str());
+    return;
   }
 
-  if (doDebug) debugPort->printf("FSmanager::addSystemFile: systemFiles.insert(%s)\n", sanitizedPath.c_str());
-  systemFiles.insert(sanitizedPath);
+  // The file is served under its bare name
+  FSPath fName;
+  fName.set(sanitizedPath.name());
+
+  // The index holds the hash of the name without ".gz", so both are protected
+  size_t hashLen = sanitizedPath.length();
+  if (sanitizedPath.endsWith(".gz")) hashLen -= 3;
+  FSM_LOG_D("FSmanager::addSystemFile: protecting [%s]", sanitizedPath.c_str());
+  insertSorted(systemFileHashes, hashPath(sanitizedPath.c_str(), hashLen));
   if (setServe)
   {
-    if (doDebug) debugPort->printf("FSmanager::addSystemFile(): server->serveStatic(\"%s\", LittleFS, \"%s\");\n", fName.c_str(), sanitizedPath.c_str());
-    server->serveStatic(fName.c_str(), LittleFS, sanitizedPath.c_str());
+    // Own handler instead of serveStatic() so ETag/Last-Modified revalidation works
+    FSM_LOG_D("FSmanager::addSystemFile(): serve \"%s\" from \"%s\" (Cache-Control: %s)", fName.c_str(), sanitizedPath.c_str(), cacheControl.c_str());
+    addRoute(fName.c_str(), HTTP_GET, [this, sanitizedPath, cacheControl]() {
+      FSM_STAT(StatSnapshot snap; this->statBegin(snap));
+      this->serveSystemFile(sanitizedPath, cacheControl);
+      FSM_STAT(this->statEnd(STAT_SYSTEMFILE, snap, true));
+    });
   }
   else
   {
-    debugPort->printf("FSmanager::addSystemFile(): server->serveStatic NOT set for \"%s\" \"%s\"\n", fName.c_str(), sanitizedPath.c_str());
+    FSM_LOG_W("FSmanager::addSystemFile(): server->serveStatic NOT set for \"%s\" \"%s\"", fName.c_str(), sanitizedPath.c_str());
   }
 
 } // addSystemFile()
@@ -99,28 +426,59 @@ std::string FSmanager::getSystemFilePath() const
   return systemPath;
 }
 
-bool FSmanager::isSystemFile(const std::string &filename)
+void FSmanager::addSystemFolder(const std::string &folder)
 {
-    std::string fname = filename;
+  // Protects everything below folder, stored as the hash of "/folder/"
+  FSPath canonical;
+  if (!canonical.set(folder.c_str(), true))
+  {
+    FSM_LOG_W("FSmanager::addSystemFolder(): invalid path [%s]", folder.c_str());
+    return;
+  }
+  FSM_LOG_D("FSmanager::addSystemFolder(): protecting [%s]", canonical.c_str());
+  insertSorted(systemPrefixHashes, hashPath(canonical.c_str(), canonical.length()));
 
-    /**** List all names in systemFiles
-    debugPort->println("Listing system files:");
-    for (const auto &file : systemFiles)
-    {
-      debugPort->printf("FSmanager::  %s\n", file.c_str());
-    }
-    ****/
+} // addSystemFolder()
+
+
+bool FSmanager::isSystemFile(const char* path)
+{
+  return isSystemFile(path, "");
+
+} // isSystemFile()
+
+
+bool FSmanager::isSystemFile(const char* folder, const char* name)
+{
+  // Checks the canonical path folder + name without joining the two. Every
+  // '/' ends a prefix that is looked up in the folder rules on the way,
+  // the complete path is looked up in the file index at the end.
+  const char* parts[2] = { folder, name };
+  size_t lengths[2] = { strlen(folder), strlen(name) };
+  size_t total = lengths[0] + lengths[1];
+
+  // "x" and its precompressed "x.gz" are the same asset
+  const char* last = (lengths[1] > 0) ? name : folder;
+  size_t lastLen = (lengths[1] > 0) ? lengths[1] : lengths[0];
+  if (lastLen > 3 && memcmp(last + lastLen - 3, ".gz", 3) == 0) total -= 3;
 
-    if (doDebug) debugPort->printf("FSmanager::isSystemFile(): Checking system file: [%s]\n", fname.c_str());
-    // Check if the file is in the systemFiles set
-    if (systemFiles.find(fname) != systemFiles.end())
+  uint32_t hash = 2166136261u;
+  size_t done = 0;
+  for (int part = 0; part < 2; part++)
+  {
+    for (size_t i = 0; i < lengths[part] && done < total; i++, done++)
     {
-        debugPort->printf("FSmanager::isSystemFile(): Found system file: [%s]\n", fname.c_str());
-        return true;
+      char c = parts[part][i];
+      hash ^= (uint8_t)c;
+      hash *= 16777619u;
+      if (c == '/' && !systemPrefixHashes.empty()
+          && std::binary_search(systemPrefixHashes.begin(), systemPrefixHashes.end(), hash)) return true;
     }
-    
-    // Default system file
-    return (fname == "index.html");
+  }
+  if (std::binary_search(systemFileHashes.begin(), systemFileHashes.end(), hash)) return true;
+  
+  // Default system file
+  return (lengths[1] == 0 && strcmp(folder, "index.html") == 0);
 
 } // isSystemFile()
 
@@ -133,758 +491,3921 @@ size_t FSmanager::getTotalSpace()
 #endif
 }
 
-size_t FSmanager::getUsedSpace()
+#ifndef ESP32
+// ESP8266 LittleFS removes a folder together with its last file, a folder
+// made by createFolder() or unpacked from an archive holds this file so it
+// stays. It is not listed.
+static const char FOLDER_PLACEHOLDER[] = "dummy.tmp";
+#endif
+
+// The listings use it on ESP8266 only, the archive code on both
+#if !defined(ESP32) || FSMANAGER_ENABLE_ARCHIVE
+static bool isFolderPlaceholder(const char* path)
 {
-  //-debug- debugPort->println("Calculating used space...");
 #ifdef ESP32
-  size_t usedBytes = 0;
-  
-  // Recursive function to calculate size of all files in a directory
-  std::function<void(const std::string&)> calculateDirSize = [&](const std::string& dirPath) {
-    //-debug- debugPort->printf("FSmanager::currentFolder [%s]\n", dirPath.c_str());
-    File dir = LittleFS.open(dirPath.c_str(), "r");
-    if (dir && dir.isDirectory()) 
-    {
-      File file = dir.openNextFile();
-      while (file) 
-      {
-        if (file.isDirectory()) 
-        {
-          // Get directory name
-          String tempName = file.name();
-          std::string subDirName(tempName.c_str());
-          
-          // Ensure the path has a leading slash
-          std::string subDirPath;
-          if (subDirName[0] != '/') {
-            // If the directory name doesn't have a leading slash, construct the full path
-            subDirPath = dirPath;
-            if (subDirPath[subDirPath.length()-1] != '/') {
-              subDirPath += "/";
-            }
-            subDirPath += subDirName;
-          } else {
-            // If it already has a leading slash, use it as is
-            subDirPath = subDirName;
-          }
-          
-          // Recursively process subdirectory
-          calculateDirSize(subDirPath);
-        } 
-        else 
-        {
-          // Add file size to total
-          usedBytes += file.size();
-          //-debug- debugPort->printf("FSmanager::File: %s, Size: %d -> totalUsed[%d]\n", file.name(), file.size(), usedBytes);
-        }
-        file = dir.openNextFile();
-      }
-    }
-    dir.close();
-  };
-  
-  // Start recursive calculation from root
-  calculateDirSize("/");
-  return usedBytes;
+  (void)path;
+  return false;
 #else
-  FSInfo fs_info;
-  LittleFS.info(fs_info);
-  return fs_info.usedBytes;
+  const char* slash = strrchr(path, '/');
+  return strcmp((slash != nullptr) ? slash + 1 : path, FOLDER_PLACEHOLDER) == 0;
 #endif
-} // getUsedSpace()
 
+} // isFolderPlaceholder()
+#endif // !ESP32 || FSMANAGER_ENABLE_ARCHIVE
 
-void FSmanager::begin(Stream* debugOutput)
+
+bool FSmanager::TreeWalker::begin(const char* folder)
 {
-  debugPort = debugOutput;
-  lastUploadSuccess = true;  // Initialize to true
-  // Convert to std::string for manipulation
-  
-  // Register handlers for file operations
-  server->on("/fsm/filelist", HTTP_GET, [this]() { this->handleFileList(); });
-  server->on("/fsm/delete", HTTP_POST, [this]() { this->handleDelete(); });
-  server->on("/fsm/download", HTTP_GET, [this]() { this->handleDownload(); });
-  server->on("/fsm/checkSpace", HTTP_GET, [this]() { this->handleCheckSpace(); });
-
-  // Modified upload handler with error reporting
-  server->on("/fsm/upload", HTTP_POST, [this]() { 
-    // Check if upload was successful
-    if (this->lastUploadSuccess) {
-      server->send(200, "text/plain", "File uploaded successfully");
-    } else {
-      // Send error response
-      server->send(507, "text/plain", "Upload failed: Insufficient storage space");
-    }
-  }, [this]() { 
-    // Reset success flag before handling upload
-    this->lastUploadSuccess = true;
-    this->handleUpload(); 
-  });
+  close();
+  skippedEntries = 0;
+  len = strlen(folder);
+  if (len == 0 || len >= sizeof(buf) || folder[len - 1] != '/')
+  {
+    len = 0;
+    buf[0] = '\0';
+    return false;
+  }
+  memcpy(buf, folder, len + 1);
+  return enter();
 
-  server->onNotFound([this]() { 
-    debugPort->printf("FSmanager::Not Found: %s\n", server->uri().c_str());
-    server->send(404, "text/plain", "404 Not Found"); 
-});
-  
-  server->on("/fsm/createFolder", HTTP_POST, [this]() { this->handleCreateFolder(); });
-  server->on("/fsm/deleteFolder", HTTP_POST, [this]() { this->handleDeleteFolder(); });
-  
-  debugPort->println("FSmanager initialized");
-}
+} // TreeWalker::begin()
 
 
-void FSmanager::handleFileList()
+bool FSmanager::TreeWalker::enter()
 {
-  //-debug- debugPort->printf("FSmanager::currentFolder [%s]\n", currentFolder.c_str());
-  std::string json = "{\"currentFolder\":\"";
-  json += currentFolder;
-  json += "\",\"files\":[";
-  std::string folder = "/";
-  
-  if (server->hasArg("folder"))
-  {
-    std::string folderArg = std::string(server->arg("folder").c_str());
-    // Remove any double slashes and ensure proper formatting
-    size_t pos;
-    while ((pos = folderArg.find("//")) != std::string::npos)
-    {
-      folderArg.replace(pos, 2, "/");
-    }
-    if (folderArg[0] != '/') folderArg = "/" + folderArg;
-    if (folderArg[folderArg.length()-1] != '/') folderArg += "/";
-    folder = folderArg;
-    currentFolder = folder;  // Update current folder
-    //-debug- debugPort->printf("FSmanager::Listing folder: %s\n", folder.c_str());
-  }
-  
+  // Opens the folder in buf on the next level of the stack
+  if (depth >= FSMANAGER_MAX_DEPTH) return false;
 #ifdef ESP32
-  File root = LittleFS.open(folder.c_str(), "r");
-  if (!root)
-  {
-    server->send(400, "application/json", "{\"error\":\"Invalid folder\"}");
-    return;
-  }
-
-  if (!root.isDirectory())
-  {
-    server->send(400, "application/json", "{\"error\":\"Not a directory\"}");
-    return;
-  }
+  File folder = owner.openFile(buf, "r");
+  if (!folder || !folder.isDirectory()) return false;
+  levels[depth] = folder;
 #else
-  // For ESP8266, check if the folder exists
-  if (!LittleFS.exists(folder.c_str()))
-  {
-    server->send(400, "application/json", "{\"error\":\"Invalid folder\"}");
-    return;
-  }
-  
-  // On ESP8266, we can't directly check if it's a directory
-  // We'll assume it's a directory if it exists, since we're using it as a directory path
-  // If it's not actually a directory, the subsequent operations will just not find any files
+  levels[depth] = owner.openDirectory(buf);
 #endif
+  levelLen[depth] = len;
+  depth++;
+  return true;
 
-  //-debug- debugPort->println("Files in folder:");
-  
-  bool first = true;
+} // TreeWalker::enter()
 
-  // First pass: Count files in each directory
-  std::map<std::string, bool> dirHasFiles;
-  std::map<std::string, int> dirFileCount;
-  
-  // Function to count files in a directory
-  std::function<int(const std::string&)> countFilesInDir = [&](const std::string& dirPath) -> int {
-    int count = 0;
-    // Ensure path starts with a slash
-    std::string path = dirPath;
-    if (path[0] != '/') path = "/" + path;
-    
+
+void FSmanager::TreeWalker::pop()
+{
+  depth--;
 #ifdef ESP32
-    File dir = LittleFS.open(path.c_str(), "r");
-    if (dir && dir.isDirectory()) {
-      File file = dir.openNextFile();
-      while (file) {
-        if (!file.isDirectory()) {
-          count++;
-        }
-        file = dir.openNextFile();
-      }
-    }
+  levels[depth].close();
 #else
-    Dir dir = LittleFS.openDir(path.c_str());
-    while (dir.next()) {
-      if (!dir.isDirectory()) {
-        count++;
-      }
-    }
+  levels[depth] = Dir();
 #endif
-    return count;
-  };
-  
-  // Process directories and files
-#ifdef ESP32
-  File file = root.openNextFile();
-  while (file)
+
+} // TreeWalker::pop()
+
+
+void FSmanager::TreeWalker::close()
+{
+  while (depth > 0) pop();
+  enterPending = false;
+
+} // TreeWalker::close()
+
+
+bool FSmanager::TreeWalker::next()
+{
+  // The folder returned last is entered before anything else is read, a
+  // folder that is too deep is returned as left right away
+  if (enterPending)
   {
-    String tempName = file.name();
-    std::string name(tempName.c_str());
-    
-    if (file.isDirectory())
-    {
-      // Ensure directory path is properly formatted
-      std::string dirPath = folder;
-      if (dirPath[dirPath.length()-1] != '/') dirPath += "/";
-      
-      // Extract just the directory name from the full path
-      std::string dirName = name;
-      size_t lastSlash = dirName.rfind('/');
-      if (lastSlash != std::string::npos) {
-        dirName = dirName.substr(lastSlash + 1);
-      }
-      
-      // Combine folder and directory name
-      std::string fullPath = dirPath + dirName;
-      if (fullPath[fullPath.length()-1] != '/') fullPath += "/";
-      
-      // Count files in this directory
-      int fileCount = countFilesInDir(fullPath);
-      dirFileCount[name] = fileCount;
-      dirHasFiles[name] = (fileCount > 0);
-      
-      //-debug- debugPort->printf("FSmanager::  DIR: %s (contains %d files)\n", name.c_str(), fileCount);
+    enterPending = false;
+    if (!enter())
+    {
+      skippedEntries++;
+      leave = true;
+      return true;
     }
-    file = root.openNextFile();
   }
-#else
-  Dir dir = LittleFS.openDir(folder.c_str());
-  while (dir.next())
+
+  while (depth > 0)
   {
-    std::string name = dir.fileName().c_str();
-    
-    if (dir.isDirectory())
+    int level = depth - 1;
+    String entryName;
+    bool found = false;
+#ifdef ESP32
+    File entry = levels[level].openNextFile();
+    if (entry)
     {
-      // Ensure directory path is properly formatted
-      std::string dirPath = folder;
-      if (dirPath[dirPath.length()-1] != '/') dirPath += "/";
-      
-      // Combine folder and directory name
-      std::string fullPath = dirPath + name;
-      if (fullPath[fullPath.length()-1] != '/') fullPath += "/";
-      
-      // Count files in this directory
-      int fileCount = countFilesInDir(fullPath);
-      dirFileCount[fullPath] = fileCount;
-      dirHasFiles[fullPath] = (fileCount > 0);
-      
-      //-debug- debugPort->printf("FSmanager::  DIR: %s (contains %d files)\n", fullPath.c_str(), fileCount);
+      found     = true;
+      entryName = entry.name();
+      dir       = entry.isDirectory();
+      fileSize  = dir ? 0 : entry.size();
+      entry.close();
+    }
+#else
+    if (levels[level].next())
+    {
+      found     = true;
+      entryName = levels[level].fileName();
+      dir       = levels[level].isDirectory();
+      fileSize  = dir ? 0 : levels[level].fileSize();
     }
-  }
 #endif
-  
-  // Second pass: List directories
-#ifdef ESP32
-  root.close();
-  root = LittleFS.open(folder.c_str(), "r");
-  file = root.openNextFile();
-  while (file)
-  {
-    String tempName = file.name();
-    std::string name(tempName.c_str());
-    
-    if (file.isDirectory())
+    if (found)
     {
-      if (!first) json += ",";
-      first = false;
-      
-      //-debug- debugPort->printf("FSmanager::  DIR: %s\n", name.c_str());
-      
-      // Check if directory is empty or contains system files
-      bool isEmpty = !dirHasFiles[name];
-      bool isReadOnly = !isEmpty; // Non-empty folders are read-only
-      
-      json += "{\"name\":\"";
-      json += name;
-      json += "\",\"isDir\":true,\"size\":";
-      json += std::to_string(dirFileCount[name]); // Use file count as size
-      json += ",\"access\":\"";
-      json += isReadOnly ? "r" : "w";
-      json += "\"}";
+      // Older cores return the full path, newer ones only the name
+      const char* name = strrchr(entryName.c_str(), '/');
+      name = (name != nullptr) ? name + 1 : entryName.c_str();
+      size_t nameLen = strlen(name);
+      size_t base = levelLen[level];
+      if (base + nameLen + (dir ? 1 : 0) >= sizeof(buf))
+      {
+        skippedEntries++;
+        continue;
+      }
+      memcpy(buf + base, name, nameLen);
+      len = base + nameLen;
+      if (dir) buf[len++] = '/';
+      buf[len] = '\0';
+      leave = false;
+      enterPending = dir;
+      return true;
     }
-    file = root.openNextFile();
+
+    // Level done, its folder is returned once more unless the walk started there
+    pop();
+    len = levelLen[level];
+    buf[len] = '\0';
+    if (depth == 0) break;
+    dir      = true;
+    leave    = true;
+    fileSize = 0;
+    return true;
   }
-#else
-  dir = LittleFS.openDir(folder.c_str());
-  while (dir.next())
+  return false;
+
+} // TreeWalker::next()
+
+
+void FSmanager::walkTree(const std::string &dirPath, const WalkCallback &visit)
+{
+  // Visits every entry below dirPath, a directory before its contents.
+  // dirPath must end in '/', directories are passed with a trailing '/'.
+  //-debug- debugPort->printf("FSmanager::walkTree [%s]\n", dirPath.c_str());
+  TreeWalker walker(*this);
+  if (!walker.begin(dirPath.c_str())) return;
+
+  std::string path;
+  while (walker.next())
   {
-    if (dir.isDirectory())
-    {
-      if (!first) json += ",";
-      first = false;
-      
-      std::string name = dir.fileName().c_str();
-      
-      // Ensure the path is properly formatted
-      std::string fullPath = folder;
-      if (fullPath[fullPath.length()-1] != '/') fullPath += "/";
-      fullPath += name;
-      if (fullPath[fullPath.length()-1] != '/') fullPath += "/";
-      
-      //-debug- debugPort->printf("FSmanager::  DIR: %s\n", fullPath.c_str());
-      
-      // Check if directory is empty
-      bool isEmpty = !dirHasFiles[fullPath];
-      bool isReadOnly = !isEmpty; // Non-empty folders are read-only
-      
-      json += "{\"name\":\"";
-      json += name; // Use normalized name without leading/trailing slashes
-      json += "\",\"isDir\":true,\"size\":";
-      json += std::to_string(dirFileCount[fullPath]); // Use file count as size
-      json += ",\"access\":\"";
-      json += isReadOnly ? "r" : "w";
-      json += "\"}";
-    }
-  }
-#endif
-
-  // Third pass: List files
-#ifdef ESP32
-  root.close();
-  root = LittleFS.open(folder.c_str(), "r");
-  file = root.openNextFile();
-  while (file)
+    if (walker.leaving()) continue;
+    path = walker.path();
+    visit(path, walker.isDir(), walker.size());
+  }
+  if (walker.skipped() > 0)
   {
-    String tempName = file.name();
-    std::string name(tempName.c_str());
-    
-    if (!file.isDirectory())
-    {
-      if (!first) json += ",";
-      first = false;
-      
-      //-debug- debugPort->printf("FSmanager::  FILE: %s (%d bytes)\n", name.c_str(), file.size());
-      // Construct the full path by appending name to folder
-      std::string fullPath = folder;
-      if (fullPath.back() != '/') fullPath += "/";
-      fullPath += name;
-      //debugPort->printf("FSmanager::  isSystemFile(%s)\n", fullPath.c_str());
-      // Check if it's a system file
-      bool isReadOnly = isSystemFile(fullPath);
-      
-      json += "{\"name\":\"";
-      json += name;
-      json += "\",\"isDir\":false,\"size\":";
-      json += std::to_string(file.size());
-      json += ",\"access\":\"";
-      json += isReadOnly ? "r" : "w";
-      json += "\"}";
-    }
-    file = root.openNextFile();
+    FSM_LOG_W("FSmanager::walkTree: %u entries below [%s] nested too deep", (unsigned)walker.skipped(), dirPath.c_str());
   }
+
+} // walkTree()
+
+
+bool FSmanager::folderExists(const char* path)
+{
+#ifdef ESP32
+  File dir = openFile(path, "r");
+  bool exists = dir && dir.isDirectory();
+  if (dir) dir.close();
+  return exists;
 #else
-  dir = LittleFS.openDir(folder.c_str());
-  while (dir.next())
+  return (strcmp(path, "/") == 0) || LittleFS.exists(path);
+#endif
+
+} // folderExists()
+
+
+size_t FSmanager::calculateUsedSpace()
+{
+  //-debug- debugPort->println("Calculating used space...");
+#ifdef ESP32
+  // usedBytes() counts whole blocks, metadata included, as FSInfo does on
+  // ESP8266. The block size is the erase size of the data partition.
+  const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+  if (partition != nullptr && partition->erase_size > 0) fsBlockSize = partition->erase_size;
+  spaceBlockSize = fsBlockSize;
+  return LittleFS.usedBytes();
+#else
+  FSInfo fs_info;
+  LittleFS.info(fs_info);
+  spaceBlockSize = fs_info.blockSize;
+  fsBlockSize = fs_info.blockSize;
+  return fs_info.usedBytes;
+#endif
+} // calculateUsedSpace()
+
+
+void FSmanager::resyncUsedSpace()
+{
+  uint32_t startTime = micros();
+  FSM_STAT(StatSnapshot snap; statBegin(snap));
+  size_t usedSpace = calculateUsedSpace();
+  FSM_STAT(statEnd(STAT_USEDSPACE, snap, true));
+  if (usedSpace != trackedUsedSpace) invalidateListings();
+  trackedUsedSpace = usedSpace;
+  lastSpaceResync = millis();
+  FSM_LOG_D("FSmanager::resyncUsedSpace(): usedSpace [%u] in %u us", (unsigned)trackedUsedSpace, (unsigned)(micros() - startTime));
+
+} // resyncUsedSpace()
+
+
+void FSmanager::setSpaceResyncInterval(uint32_t intervalMs)
+{
+  spaceResyncInterval = intervalMs;
+
+} // setSpaceResyncInterval()
+
+
+size_t FSmanager::getUsedSpace()
+{
+  // The counter is kept current by the handlers, a full recalculation
+  // is only done when the (optional) resync interval has passed
+  if (spaceResyncInterval > 0 && (millis() - lastSpaceResync) >= spaceResyncInterval)
   {
-    if (!dir.isDirectory())
-    {
-      if (!first) json += ",";
-      first = false;
-      
-      std::string name = dir.fileName().c_str();
-      
-      // Construct the full path by appending name to folder
-      std::string fullPath = folder;
-      if (fullPath.back() != '/') fullPath += "/";
-      fullPath += name;
-      
-      debugPort->printf("FSmanager::  FILE: %s (%d bytes)\n", fullPath.c_str(), dir.fileSize());
-      debugPort->printf("FSmanager::  isSyestemFile(%s)\n", fullPath.c_str());
-      
-      // Check if it's a system file
-      bool isReadOnly = isSystemFile(fullPath);
-      
-      json += "{\"name\":\"";
-      json += name; // Use normalized name without leading slash
-      json += "\",\"isDir\":false,\"size\":";
-      json += std::to_string(dir.fileSize());
-      json += ",\"access\":\"";
-      json += isReadOnly ? "r" : "w";
-      json += "\"}";
-    }
+    resyncUsedSpace();
   }
+  return trackedUsedSpace;
+
+} // getUsedSpace()
+
+
+void FSmanager::adjustUsedSpace(size_t removedBytes, size_t addedBytes)
+{
+  // Both cores report used space in whole blocks (FSInfo on ESP8266,
+  // usedBytes() on ESP32), so a change is rounded up to the block size
+  size_t removed = ((removedBytes + spaceBlockSize - 1) / spaceBlockSize) * spaceBlockSize;
+  size_t added   = ((addedBytes   + spaceBlockSize - 1) / spaceBlockSize) * spaceBlockSize;
+
+  trackedUsedSpace = (trackedUsedSpace > removed) ? (trackedUsedSpace - removed) : 0;
+  trackedUsedSpace += added;
+
+} // adjustUsedSpace()
+
+
+void FSmanager::begin(Stream* debugOutput)
+{
+  debugPort = debugOutput;
+
+  // Walk the filesystem once, the handlers keep the counter up to date
+  resyncUsedSpace();
+
+#if !FSMANAGER_ASYNC
+  // The WebServer only keeps request headers it has been asked for
+  static const char* headerKeys[] = { "If-None-Match", "If-Modified-Since", "Range", "If-Range", "Accept-Encoding", "Content-Length" };
+  server->collectHeaders(headerKeys, sizeof(headerKeys) / sizeof(headerKeys[0]));
 #endif
+  // Convert to std::string for manipulation
   
-  json += "],";
-  json += "\"totalSpace\":";
-  json += std::to_string(getTotalSpace());
-  json += ",\"usedSpace\":";
-  json += std::to_string(getUsedSpace());
-  json += "}";
+  // Register handlers for file operations, see FSMANAGER_ENABLE_* for
+  // the endpoints that are compiled in
+  addRoute("/fsm/filelist", HTTP_GET, [this]() { this->runHandler(STAT_FILELIST, &FSmanager::handleFileList); });
+#if FSMANAGER_ENABLE_DELETE
+  addRoute("/fsm/delete", HTTP_POST, [this]() { this->runHandler(STAT_DELETE, &FSmanager::handleDelete); });
+#endif
+  addRoute("/fsm/download", HTTP_GET, [this]() { this->runHandler(STAT_DOWNLOAD, &FSmanager::handleDownload); });
+
+#if FSMANAGER_ENABLE_UPLOAD
+  addRoute("/fsm/checkSpace", HTTP_GET, [this]() { this->runHandler(STAT_CHECKSPACE, &FSmanager::handleCheckSpace); });
+
+  // Upload handler with error reporting, the success flag is reset by
+  // handleUpload() at UPLOAD_FILE_START
+  addRoute("/fsm/upload", HTTP_POST, [this]() { this->runHandler(STAT_UPLOAD, &FSmanager::handleUploadDone); }
+                                   , [this]() { this->runHandler(STAT_UPLOAD, &FSmanager::handleUpload, false); });
+#endif
+
+#if FSMANAGER_ENABLE_CHUNKED
+  // Resumable chunked uploads
+  addRoute("/fsm/chunked/start", HTTP_POST, [this]() { this->runHandler(STAT_CHUNKED_CONTROL, &FSmanager::handleChunkedStart); });
+  addRoute("/fsm/chunked/chunk", HTTP_POST, [this]() { this->runHandler(STAT_CHUNKED, &FSmanager::handleChunkedChunk); }
+                                          , [this]() { this->runHandler(STAT_CHUNKED, &FSmanager::handleChunkedData, false); });
+  addRoute("/fsm/chunked/status", HTTP_GET, [this]() { this->runHandler(STAT_CHUNKED_CONTROL, &FSmanager::handleChunkedStatus); });
+  addRoute("/fsm/chunked/commit", HTTP_POST, [this]() { this->runHandler(STAT_CHUNKED_CONTROL, &FSmanager::handleChunkedCommit); });
+  addRoute("/fsm/chunked/cancel", HTTP_POST, [this]() { this->runHandler(STAT_CHUNKED_CONTROL, &FSmanager::handleChunkedCancel); });
+#endif
+
+  auto notFound = [this]() { 
+    FSM_LOG_W("FSmanager::Not Found: %s", server->uri().c_str());
+    server->send(404, "text/plain", "404 Not Found"); 
+  };
+#if FSMANAGER_ASYNC
+  webServer->onNotFound([this, notFound](AsyncWebServerRequest* request) { this->handleAsync(request, notFound); });
+#else
+  webServer->onNotFound(notFound);
+#endif
   
-  server->send(200, "application/json", json.c_str());
+#if FSMANAGER_ENABLE_FOLDERS
+  addRoute("/fsm/createFolder", HTTP_POST, [this]() { this->runHandler(STAT_CREATEFOLDER, &FSmanager::handleCreateFolder); });
+  addRoute("/fsm/deleteFolder", HTTP_POST, [this]() { this->runHandler(STAT_DELETEFOLDER, &FSmanager::handleDeleteFolder); });
+#endif
+#if FSMANAGER_ENABLE_BATCH
+  addRoute("/fsm/batch", HTTP_POST, [this]() { this->runHandler(STAT_BATCH, &FSmanager::handleBatch); }, nullptr, FSMANAGER_BATCH_MAX_BODY);
+#endif
+#if FSMANAGER_ENABLE_ARCHIVE
+  addRoute("/fsm/archive", HTTP_GET, [this]() { this->runHandler(STAT_ARCHIVE, &FSmanager::handleArchive); });
+#endif
+#if FSMANAGER_STATS
+  addRoute("/fsm/stats", HTTP_GET, [this]() { this->handleStats(); });
+#endif
   
-} // handleFileList()
+  FSM_LOG_I("FSmanager initialized");
+}
 
 
-void FSmanager::handleDelete()
+size_t FSmanager::countFilesInDir(const std::string &dirPath, bool countDirs)
 {
-  if (!server->hasArg("file")) 
+  size_t count = 0;
+
+#ifdef ESP32
+  File dir = openFile(dirPath.c_str(), "r");
+  if (dir && dir.isDirectory())
   {
-    server->send(400, "text/plain", "Missing file parameter");
-    return;
+    File file = dir.openNextFile();
+    while (file)
+    {
+      if (countDirs || !file.isDirectory()) count++;
+      file = dir.openNextFile();
+    }
   }
-  
-  std::string filename = std::string(server->arg("file").c_str());
-  
-  // Check if it's a system file
-  if (isSystemFile(filename))
+  if (dir) dir.close();
+#else
+  Dir dir = openDirectory(dirPath.c_str());
+  while (dir.next())
   {
-    server->send(403, "text/plain", "Cannot delete system file");
-    return;
+    if (isFolderPlaceholder(dir.fileName().c_str())) continue;
+    if (countDirs || !dir.isDirectory()) count++;
   }
-  
-  if (LittleFS.remove(filename.c_str()))
+#endif
+  return count;
+
+} // countFilesInDir()
+
+
+void FSmanager::addListEntry(const char* name, bool isDir, size_t size, size_t originalSize)
+{
+  // Strip any leading path, only the bare name is stored
+  const char* slash = strrchr(name, '/');
+  if (slash != nullptr) name = slash + 1;
+
+  ListEntry entry;
+  entry.nameOffset = listNames.size();
+  entry.isDir      = isDir;
+  entry.size       = size;
+  entry.originalSize = originalSize;
+  listNames.insert(listNames.end(), name, name + strlen(name) + 1);
+  listEntries.push_back(entry);
+
+} // addListEntry()
+
+
+size_t FSmanager::gzipOriginalSize(File &file)
+{
+  // The last four bytes of a gzip file hold the uncompressed size (ISIZE)
+  size_t size = file.size();
+  const char* name = file.name();
+  size_t nameLen = strlen(name);
+  if (size < 18 || nameLen < 3 || strcmp(name + nameLen - 3, ".gz") != 0) return 0;
+
+  uint8_t trailer[4];
+  if (!file.seek(size - 4, SeekSet) || file.read(trailer, 4) != 4) return 0;
+  return (size_t)trailer[0] | ((size_t)trailer[1] << 8) | ((size_t)trailer[2] << 16) | ((size_t)trailer[3] << 24);
+
+} // gzipOriginalSize()
+
+
+void FSmanager::readDirectory(const std::string &folder)
+{
+  // Buffers are cleared but keep their capacity between requests
+  listEntries.clear();
+  listNames.clear();
+
+  // Single pass over the folder, sizes of sub folders are filled in below
+#ifdef ESP32
+  File root = openFile(folder.c_str(), "r");
+  File file = root.openNextFile();
+  while (file)
   {
-    if (doDebug) debugPort->printf("FSmanager::Deleted file: %s\n", filename.c_str());
-    server->send(200, "text/plain", "File deleted successfully");
+    bool isDir = file.isDirectory();
+    addListEntry(file.name(), isDir, isDir ? 0 : file.size(), isDir ? 0 : gzipOriginalSize(file));
+    file = root.openNextFile();
   }
-  else
+  root.close();
+#else
+  Dir dir = openDirectory(folder.c_str());
+  while (dir.next())
   {
-    debugPort->printf("FSmanager::Failed to delete file: %s\n", filename.c_str());
-    server->send(500, "text/plain", "Failed to delete file");
+    if (isFolderPlaceholder(dir.fileName().c_str())) continue;
+    bool isDir = dir.isDirectory();
+    size_t originalSize = 0;
+    if (!isDir && dir.fileName().endsWith(".gz"))
+    {
+      File file = dir.openFile("r");
+      originalSize = gzipOriginalSize(file);
+      file.close();
+    }
+    addListEntry(dir.fileName().c_str(), isDir, isDir ? 0 : dir.fileSize(), originalSize);
   }
-}
+#endif
 
-void FSmanager::handleDownload()
+  // Directories first, files after, both in enumeration order
+  std::stable_partition(listEntries.begin(), listEntries.end(),
+                        [](const ListEntry &entry) { return entry.isDir; });
+
+  countSubfolderFiles(folder);
+
+} // readDirectory()
+
+
+void FSmanager::countSubfolderFiles(const std::string &folder)
 {
-  if (!server->hasArg("file")) 
-  {
-    server->send(400, "text/plain", "Missing file parameter");
-    return;
-  }
-  
-  std::string filename = std::string(server->arg("file").c_str());
-  debugPort->printf("FSmanager::Download request for file: %s\n", filename.c_str());
-  
-  File file = LittleFS.open(filename.c_str(), "r");
-  if (!file)
+  // For directories the size is the number of files they contain
+  std::string path;
+  for (ListEntry &entry : listEntries)
   {
-    server->send(404, "text/plain", "File not found");
-    return;
+    if (!entry.isDir) continue;
+    path = folder;
+    path += &listNames[entry.nameOffset];
+    path += "/";
+    entry.size = countFilesInDir(path);
+    //-debug- debugPort->printf("FSmanager::  DIR: %s (contains %u files)\n", path.c_str(), (unsigned)entry.size);
   }
-  
-  // Determine MIME type based on file extension
-  std::string contentType = "application/octet-stream";
-  
-  // Helper function to check if string ends with a specific suffix
-  auto endsWith = [](const std::string& str, const std::string& suffix) -> bool {
-    return str.size() >= suffix.size() && 
-           str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
-  };
-  
-  if (endsWith(filename, ".html") || endsWith(filename, ".htm")) contentType = "text/html";
-  else if (endsWith(filename, ".css")) contentType = "text/css";
-  else if (endsWith(filename, ".js")) contentType = "application/javascript";
-  else if (endsWith(filename, ".json")) contentType = "application/json";
-  else if (endsWith(filename, ".png")) contentType = "image/png";
-  else if (endsWith(filename, ".jpg") || endsWith(filename, ".jpeg")) contentType = "image/jpeg";
-  else if (endsWith(filename, ".gif")) contentType = "image/gif";
-  else if (endsWith(filename, ".ico")) contentType = "image/x-icon";
-  else if (endsWith(filename, ".txt")) contentType = "text/plain";
-  
-  // Extract just the filename without path for Content-Disposition
-  size_t lastSlash = filename.find_last_of('/');
-  std::string bareFilename = (lastSlash != std::string::npos) ? filename.substr(lastSlash + 1) : filename;
-  
-  server->sendHeader("Content-Disposition", "attachment; filename=" + String(bareFilename.c_str()));
-  server->streamFile(file, contentType.c_str());
-  file.close();
-}
 
-void FSmanager::handleCheckSpace()
+} // countSubfolderFiles()
+
+
+void FSmanager::closeListPager()
 {
-  if (!server->hasArg("size")) 
+#ifdef ESP32
+  if (listPager.dir) listPager.dir.close();
+#else
+  listPager.dir = Dir();
+#endif
+  listPager.open = false;
+
+} // closeListPager()
+
+
+void FSmanager::readDirectoryPage(const std::string &folder, size_t offset, size_t limit)
+{
+  listEntries.clear();
+  listNames.clear();
+
+  // Continue with the open directory when this page starts at or after the
+  // point where the previous page stopped, otherwise enumerate from the start
+  bool current = listPager.folder == folder && listPager.generation == listGeneration;
+  bool resume = current && listPager.open && listPager.position <= offset;
+  if (!resume)
   {
-    server->send(400, "text/plain", "Missing size parameter");
-    return;
+    closeListPager();
+    if (!current)
+    {
+      listPager.folder     = folder;
+      listPager.generation = listGeneration;
+      listPager.total      = 0;
+      listPager.counted    = false;
+    }
+    listPager.position = 0;
+#ifdef ESP32
+    listPager.dir = openFile(folder.c_str(), "r");
+    listPager.open = listPager.dir && listPager.dir.isDirectory();
+#else
+    listPager.dir = openDirectory(folder.c_str());
+    listPager.open = true;
+#endif
+    if (!listPager.open) return;
   }
-  
-  size_t requestedSize = atoi(server->arg("size").c_str());
-  size_t totalSpace = getTotalSpace();
-  size_t usedSpace = getUsedSpace();
-  size_t availableSpace = totalSpace - usedSpace;
-  
-  debugPort->printf("FSmanager::Check space request: size=%zu, available=%zu\n", requestedSize, availableSpace);
-  
-  if (requestedSize > availableSpace)
+
+  // The total is counted once per folder and generation, with a handle of
+  // its own, so the pager stays where this page ends and the next page
+  // continues from there instead of walking the folder again
+  if (!listPager.counted)
   {
-    server->send(413, "text/plain", "Not enough space");
-    return;
+    listPager.total = countFilesInDir(folder, true);
+    listPager.counted = true;
   }
-  
-  server->send(200, "text/plain", "Space available");
-}
 
-void FSmanager::handleUpload()
-{
-  HTTPUpload& upload = server->upload();
-  
-  if (upload.status == UPLOAD_FILE_START)
+  // Entries before offset are passed over, entries are kept in enumeration order
+#ifdef ESP32
+  while (listEntries.size() < limit)
   {
-    std::string filename = std::string(upload.filename.c_str());
-    
-    // Get the target folder from the request or use currentFolder if not specified
-    uploadFolder = currentFolder;  // Use currentFolder as default
-    if (server->hasArg("folder"))
-    {
-      uploadFolder = std::string(server->arg("folder").c_str());
-      if (uploadFolder[uploadFolder.length()-1] != '/') uploadFolder += "/";
-    }
-    
-    // Create the full path
-    std::string filepath = uploadFolder + filename;
-    debugPort->printf("FSmanager::Upload started: %s\n", filepath.c_str());
-    
-    // Check if there's enough space
-    size_t totalSpace = getTotalSpace();
-    size_t usedSpace = getUsedSpace();
-    size_t availableSpace = totalSpace - usedSpace;
-    
-    // We don't know the file size yet, but we'll check during the upload process
-    
-    uploadFile = LittleFS.open(filepath.c_str(), "w");
-    if (!uploadFile)
-    {
-      debugPort->println("Failed to open file for writing");
-      lastUploadSuccess = false;
-      return;
-    }
+    File file = listPager.dir.openNextFile();
+    if (!file) break;
+    size_t position = listPager.position++;
+    if (position < offset) continue;
+    bool isDir = file.isDirectory();
+    addListEntry(file.name(), isDir, isDir ? 0 : file.size(), isDir ? 0 : gzipOriginalSize(file));
   }
-  else if (upload.status == UPLOAD_FILE_WRITE)
+#else
+  while (listEntries.size() < limit && listPager.dir.next())
   {
-    if (uploadFile)
+    if (isFolderPlaceholder(listPager.dir.fileName().c_str())) continue;
+    size_t position = listPager.position++;
+    if (position < offset) continue;
+    bool isDir = listPager.dir.isDirectory();
+    size_t originalSize = 0;
+    if (!isDir && listPager.dir.fileName().endsWith(".gz"))
     {
-      uploadFile.write(upload.buf, upload.currentSize);
+      File file = listPager.dir.openFile("r");
+      originalSize = gzipOriginalSize(file);
+      file.close();
     }
+    addListEntry(listPager.dir.fileName().c_str(), isDir, isDir ? 0 : listPager.dir.fileSize(), originalSize);
   }
-  else if (upload.status == UPLOAD_FILE_END)
+#endif
+
+  countSubfolderFiles(folder);
+
+} // readDirectoryPage()
+
+
+void FSmanager::handleFileList()
+{
+  // Every client browses its own folder
+  ClientContext &client = clientContext();
+  //-debug- debugPort->printf("FSmanager::currentFolder [%s]\n", client.currentFolder.c_str());
+  uint32_t startTime = micros();
+  FSPath folderPath;
+  folderPath.set("/", true);
+  
+  if (server->hasArg("folder"))
   {
-    if (uploadFile)
+    if (!folderPath.set(server->arg("folder").c_str(), true))
     {
-      uploadFile.close();
-      debugPort->printf("FSmanager::Upload complete: %d bytes\n", upload.totalSize);
+      server->send(400, "application/json", "{\"error\":\"Invalid folder\"}");
+      return;
     }
+    client.currentFolder = folderPath.c_str();  // Update current folder
+    //-debug- debugPort->printf("FSmanager::Listing folder: %s\n", folderPath.c_str());
   }
-}
+  std::string folder = folderPath.c_str();
 
+  // Resync (if due) before the ETag is made, it may change the generation
+  size_t usedSpace = getUsedSpace();
 
-void FSmanager::handleCreateFolder()
-{
-  if (!server->hasArg("name")) 
+  // A page is listed, cached and revalidated like a folder of its own
+  bool paged = server->hasArg("limit");
+  size_t offset = 0;
+  size_t limit = 0;
+  std::string listKey = folder;
+  if (paged)
   {
-    if (doDebug) debugPort->println("Error: Missing folder name parameter");
-    server->send(400, "text/plain", "Missing folder name parameter");
-    return;
-  }
-  
-  std::string folderName = std::string(server->arg("name").c_str());
-  if (folderName[0] != '/') folderName = "/" + folderName;
-  if (folderName[folderName.length()-1] != '/') folderName += "/";
-  
-  if (doDebug) debugPort->printf("FSmanager::Creating folder request: %s\n", folderName.c_str());
-  
-  // Check if the folder path has more than one level
-  int slashCount = 0;
-  for (char c : folderName) {
-    if (c == '/') slashCount++;
+    if (!readPageArgs(offset, limit)) return;
+    char page[24];
+    snprintf(page, sizeof(page), "\n%x,%x", (unsigned)offset, (unsigned)limit);
+    listKey += page;
   }
-  
-  // We expect exactly 2 slashes for a top-level folder (/folder1/)
-  // or 3 slashes for a one-level subfolder (/folder1/subfolder/)
-  if (slashCount > 3) {
-    debugPort->printf("FSmanager::Error: Only one level of subfolders is allowed. Slash count: %d\n", slashCount);
-    server->send(400, "text/plain", "Only one level of subfolders is allowed");
+
+  // Nothing changed since the client's copy was made -> 304, no flash access
+  char etag[32];
+  makeListETag(listKey, client.currentFolder, etag, sizeof(etag));
+  if (server->header("If-None-Match") == etag)
+  {
+    server->sendHeader("ETag", etag);
+    server->send(304);
     return;
   }
   
 #ifdef ESP32
-  // For one-level subfolder, create parent directory first if needed
-  if (slashCount == 3) {
-    // Extract parent folder path
-    size_t secondSlashPos = folderName.find('/', 1);
-    if (secondSlashPos != std::string::npos) {
-      std::string parentFolder = folderName.substr(0, secondSlashPos + 1);
-      if (doDebug) debugPort->printf("FSmanager::Checking parent directory: %s\n", parentFolder.c_str());
-      
-      // Check if parent folder exists
-      File parentDir = LittleFS.open(parentFolder.c_str(), "r");
-      if (!parentDir || !parentDir.isDirectory()) {
-        if (doDebug) debugPort->printf("FSmanager::Creating parent directory: %s\n", parentFolder.c_str());
-        if (!LittleFS.mkdir(parentFolder.c_str())) {
-          debugPort->println("Failed to create parent directory");
-          server->send(500, "text/plain", "Failed to create parent directory");
-          return;
-        }
-        if (doDebug) debugPort->println("Parent directory created successfully");
-      }
-      if (parentDir) parentDir.close();
-    }
-  }
-  
-  // Create the final directory
-  if (doDebug) debugPort->printf("FSmanager::Creating directory: %s\n", folderName.c_str());
-  
-  // Remove trailing slash for mkdir
-  std::string folderPath = folderName;
-  if (folderPath[folderPath.length()-1] == '/') {
-    folderPath = folderPath.substr(0, folderPath.length()-1);
-  }
-  
-  if (LittleFS.mkdir(folderPath.c_str()))
+  File root = openFile(folder.c_str(), "r");
+  if (!root)
   {
-    if (doDebug) debugPort->println("Folder created successfully");
-    server->send(200, "text/plain", "Folder created successfully");
+    server->send(400, "application/json", "{\"error\":\"Invalid folder\"}");
+    return;
   }
-  else
+
+  if (!root.isDirectory())
   {
-    debugPort->println("Failed to create folder");
-    server->send(500, "text/plain", "Failed to create folder");
+    server->send(400, "application/json", "{\"error\":\"Not a directory\"}");
+    return;
   }
+  root.close();
 #else
-  // ESP8266 doesn't have a direct mkdir function
-  // We need to create the directory structure manually
-  
-  if (doDebug) debugPort->println("ESP8266: Using alternative folder creation method");
-  
-  // For one-level subfolder, create parent directory first if needed
-  if (slashCount == 3) {
-    // Extract parent folder path
-    size_t secondSlashPos = folderName.find('/', 1);
-    if (secondSlashPos != std::string::npos) {
-      std::string parentFolder = folderName.substr(0, secondSlashPos + 1);
-      if (doDebug) debugPort->printf("FSmanager::ESP8266: Checking parent directory: %s\n", parentFolder.c_str());
-      
-      // Try to open the parent directory to see if it exists
-      File parentDir = LittleFS.open(parentFolder.c_str(), "r");
-      if (!parentDir) {
-        if (doDebug) debugPort->printf("FSmanager::ESP8266: Parent directory doesn't exist, creating: %s\n", parentFolder.c_str());
-        
-        // Create parent directory using dummy file technique
-        std::string dummyFile = parentFolder + "dummy.tmp";
-        if (doDebug) debugPort->printf("FSmanager::ESP8266: Creating dummy file: %s\n", dummyFile.c_str());
-        
-        File file = LittleFS.open(dummyFile.c_str(), "w");
-        if (!file) {
-          debugPort->println("ESP8266: Failed to create parent directory");
-          server->send(500, "text/plain", "Failed to create parent directory");
-          return;
-        }
-        
-        // Write something to the file to ensure it's created
-        file.println("dummy");
-        file.close();
-        
-        // Verify the file was created
-        File checkFile = LittleFS.open(dummyFile.c_str(), "r");
-        if (!checkFile) {
-          debugPort->println("ESP8266: Failed to verify dummy file creation");
-          server->send(500, "text/plain", "Failed to create parent directory");
-          return;
-        }
-        checkFile.close();
-        
-        if (doDebug) debugPort->println("ESP8266: Parent directory created successfully");
-      } else {
-        parentDir.close();
-        if (doDebug) debugPort->println("ESP8266: Parent directory already exists");
-      }
-    }
-  }
-  
-  // Check if the folder already exists
-  if (doDebug) debugPort->printf("FSmanager::ESP8266: Checking if folder exists: %s\n", folderName.c_str());
-  File checkDir = LittleFS.open(folderName.c_str(), "r");
-  if (checkDir) {
-    checkDir.close();
-    if (doDebug) debugPort->println("ESP8266: Folder already exists");
-    server->send(200, "text/plain", "Folder already exists");
+  // For ESP8266, check if the folder exists
+  if (!LittleFS.exists(folder.c_str()))
+  {
+    server->send(400, "application/json", "{\"error\":\"Invalid folder\"}");
     return;
   }
   
-  // Create the final directory
-  if (doDebug) debugPort->printf("FSmanager::ESP8266: Creating directory: %s\n", folderName.c_str());
-  
-  // Create a dummy file in the folder
-  std::string dummyFile = folderName + "dummy.tmp";
-  if (doDebug) debugPort->printf("FSmanager::ESP8266: Creating dummy file: %s\n", dummyFile.c_str());
-  
-  File file = LittleFS.open(dummyFile.c_str(), "w");
-  if (!file) {
-    debugPort->println("ESP8266: Failed to create folder - could not create dummy file");
-    server->send(500, "text/plain", "Failed to create folder");
+  // On ESP8266, we can't directly check if it's a directory
+  // We'll assume it's a directory if it exists, since we're using it as a directory path
+  // If it's not actually a directory, the subsequent operations will just not find any files
+#endif
+
+  server->sendHeader("ETag", etag);
+  server->sendHeader("Cache-Control", "no-cache");
+
+  // Same listing already serialized for this generation (the cache is
+  // keyed by folder, so only used when the reported currentFolder matches)
+  bool cacheable = (client.currentFolder == folder);
+  ListCacheEntry* cached = cacheable ? findListCache(listKey) : nullptr;
+  if (cached != nullptr)
+  {
+    server->setContentLength(cached->json.length());
+    server->send(200, "application/json", "");
+    server->sendContent(cached->json.c_str(), cached->json.length());
+    FSM_STAT(statBytesOut += cached->json.length());
+    FSM_LOG_D("FSmanager::Listing [%s] from cache, %u bytes in %u us"
+             , folder.c_str(), (unsigned)cached->json.length(), (unsigned)(micros() - startTime));
+    return;
+  }
+
+  // Paged entries come in enumeration order, a whole folder sorted
+  if (paged) readDirectoryPage(folder, offset, limit);
+  else       readDirectory(folder);
+
+  // Everything after the entries
+  char tail[160];
+  int tailLen = snprintf(tail, sizeof(tail), "]");
+  if (paged)
+  {
+    size_t next = offset + listEntries.size();
+    tailLen += snprintf(tail + tailLen, sizeof(tail) - tailLen, ",\"offset\":%u,\"total\":%u", (unsigned)offset, (unsigned)listPager.total);
+    if (next < listPager.total && !listEntries.empty())
+    {
+      tailLen += snprintf(tail + tailLen, sizeof(tail) - tailLen, ",\"nextCursor\":\"%x.%x\"", (unsigned)listGeneration, (unsigned)next);
+    }
+  }
+  snprintf(tail + tailLen, sizeof(tail) - tailLen, ",\"totalSpace\":%u,\"usedSpace\":%u}", (unsigned)getTotalSpace(), (unsigned)usedSpace);
+
+#if FSMANAGER_ASYNC
+  streamList(folder, client.currentFolder, tail, cacheable ? listKey : std::string());
+#else
+  // Stream the listing so heap use does not grow with the size of the JSON,
+  // small listings are captured for the cache while they are sent
+  ListCacheEntry* slot = cacheable ? claimListCache(listKey) : nullptr;
+  beginChunkedResponse(200, "application/json");
+  chunkCapture = cacheable ? &slot->json : nullptr;
+  sendChunk("{\"currentFolder\":\"");
+  sendChunk(client.currentFolder.c_str());
+  sendChunk("\",\"files\":[");
+  sendListFiles(folder);
+  sendChunk(tail);
+  endChunkedResponse();
+
+  if (chunkCapture != nullptr)
+  {
+    slot->generation = listGeneration;
+    slot->valid = true;
+  }
+  chunkCapture = nullptr;
+#endif
+
+  FSM_LOG_D("FSmanager::Listing [%s] %u entries in %u us, free heap %u"
+           , folder.c_str(), (unsigned)listEntries.size()
+           , (unsigned)(micros() - startTime), (unsigned)ESP.getFreeHeap());
+  
+} // handleFileList()
+
+
+void FSmanager::sendListFiles(const std::string &folder)
+{
+  bool first = true;
+  for (const ListEntry &entry : listEntries)
+  {
+    sendListFile(folder, entry, &listNames[entry.nameOffset], first);
+  }
+
+} // sendListFiles()
+
+
+void FSmanager::sendListFile(const std::string &folder, const ListEntry &entry, const char* name, bool &first)
+{
+  bool isReadOnly;
+  if (entry.isDir)
+  {
+    isReadOnly = (entry.size > 0);  // Non-empty folders are read-only
+  }
+  else
+  {
+    isReadOnly = isSystemFile(folder.c_str(), name);
+  }
+  sendListEntry(name, entry.isDir, entry.size, isReadOnly, first, entry.originalSize);
+
+} // sendListFile()
+
+
+#if FSMANAGER_ASYNC
+void FSmanager::streamList(const std::string &folder, const std::string &currentFolder, const char* tail, const std::string &cacheKey)
+{
+  // The entries move to the stream, other requests may list before the
+  // server has pulled the last piece
+  std::shared_ptr<ListStream> list = std::make_shared<ListStream>();
+  list->folder = folder;
+  list->entries.swap(listEntries);
+  list->names.swap(listNames);
+  list->pending = "{\"currentFolder\":\"";
+  list->pending += currentFolder;
+  list->pending += "\",\"files\":[";
+  list->tail = tail;
+  list->cacheKey = cacheKey;
+  if (!cacheKey.empty()) list->capture = list->pending;
+  list->generation = listGeneration;
+  server->streamChunked("application/json", [this, list](uint8_t* buffer, size_t maxLen) {
+    return this->readList(*list, buffer, maxLen);
+  });
+
+} // streamList()
+
+
+size_t FSmanager::readList(ListStream &list, uint8_t* buffer, size_t maxLen)
+{
+  // Sends what is pending, then makes the text of the next entry, then
+  // the tail. A listing that fits is cached once its last piece is made.
+  size_t filled = 0;
+  while (filled < maxLen)
+  {
+    if (list.pendingSent < list.pending.length())
+    {
+      size_t part = std::min(maxLen - filled, list.pending.length() - list.pendingSent);
+      memcpy(buffer + filled, list.pending.data() + list.pendingSent, part);
+      list.pendingSent += part;
+      filled += part;
+      continue;
+    }
+
+    list.pending.clear();
+    list.pendingSent = 0;
+    if (list.next < list.entries.size())
+    {
+      const ListEntry &entry = list.entries[list.next];
+      bool first = (list.next == 0);
+      chunkSink = &list.pending;
+      sendListFile(list.folder, entry, &list.names[entry.nameOffset], first);
+      chunkSink = nullptr;
+      list.next++;
+    }
+    else if (!list.tail.empty())
+    {
+      list.pending.swap(list.tail);
+    }
+    else
+    {
+      break;
+    }
+
+    if (list.cacheKey.empty()) continue;
+    if (list.capture.length() + list.pending.length() > FSMANAGER_LIST_CACHE_MAX_BYTES)
+    {
+      list.cacheKey.clear();
+      std::string().swap(list.capture);
+      continue;
+    }
+    list.capture += list.pending;
+    if (list.tail.empty() && list.next >= list.entries.size() && list.generation == listGeneration)
+    {
+      ListCacheEntry* slot = claimListCache(list.cacheKey);
+      slot->json.swap(list.capture);
+      slot->generation = list.generation;
+      slot->valid = true;
+      list.cacheKey.clear();
+    }
+  }
+  FSM_STAT(statBytesOut += filled);
+  return filled;
+
+} // readList()
+#endif // FSMANAGER_ASYNC
+
+
+bool FSmanager::readPageArgs(size_t &offset, size_t &limit)
+{
+  // A cursor is "<generation>.<offset>" in hex, it fails once the filesystem changed
+  offset = 0;
+  if (server->hasArg("cursor"))
+  {
+    char* dot;
+    uint32_t generation = strtoul(server->arg("cursor").c_str(), &dot, 16);
+    if (*dot != '.' || generation != listGeneration)
+    {
+      server->send(409, "application/json", "{\"error\":\"Listing changed, start again\"}");
+      return false;
+    }
+    offset = strtoul(dot + 1, nullptr, 16);
+  }
+  else if (server->hasArg("offset"))
+  {
+    offset = strtoul(server->arg("offset").c_str(), nullptr, 10);
+  }
+  limit = strtoul(server->arg("limit").c_str(), nullptr, 10);
+  if (limit == 0 || limit > FSMANAGER_LIST_PAGE_MAX) limit = FSMANAGER_LIST_PAGE_MAX;
+  return true;
+
+} // readPageArgs()
+
+
+void FSmanager::invalidateListings()
+{
+  // A batch or a piece of an archive bumps the generation only once,
+  // when it is done (see holdInvalidation())
+  if (invalidationHolds > 0)
+  {
+    invalidationPending = true;
+    return;
+  }
+
+  // Every cached listing and every ETag handed out becomes stale
+  listGeneration++;
+  if (listPager.open) closeListPager();
+
+} // invalidateListings()
+
+
+void FSmanager::holdInvalidation()
+{
+  // Held only for the duration of one handler or upload callback, so the
+  // changes of other clients in between are never deferred. Holds nest,
+  // the listings are invalidated when the outermost one is released.
+  invalidationHolds++;
+
+} // holdInvalidation()
+
+
+void FSmanager::releaseInvalidation()
+{
+  if (invalidationHolds == 0 || --invalidationHolds > 0) return;
+  if (invalidationPending)
+  {
+    invalidationPending = false;
+    invalidateListings();
+  }
+
+} // releaseInvalidation()
+
+
+void FSmanager::makeListETag(const std::string &folder, const std::string &currentFolder, char* etag, size_t size)
+{
+  // FNV-1a over the folder and the reported currentFolder, combined
+  // with the generation counter. The generation starts again at every
+  // boot, the boot nonce keeps a tag from an earlier boot from matching.
+  uint32_t hash = 2166136261u;
+  for (char c : folder)
+  {
+    hash ^= (uint8_t)c;
+    hash *= 16777619u;
+  }
+  for (char c : currentFolder)
+  {
+    hash ^= (uint8_t)c;
+    hash *= 16777619u;
+  }
+  snprintf(etag, size, "\"%08x-%08x-%08x\"", (unsigned)bootNonce, (unsigned)listGeneration, (unsigned)hash);
+
+} // makeListETag()
+
+
+FSmanager::ClientContext &FSmanager::clientContext()
+{
+  // Known client, else the least recently seen slot starts again at "/"
+  uint32_t address = (uint32_t)server->client().remoteIP();
+  ClientContext* slot = &clientContexts[0];
+  for (ClientContext &context : clientContexts)
+  {
+    if (context.lastUsed != 0 && context.address == address)
+    {
+      slot = &context;
+      break;
+    }
+    if (context.lastUsed < slot->lastUsed) slot = &context;
+  }
+  if (slot->lastUsed == 0 || slot->address != address)
+  {
+    slot->address = address;
+    slot->currentFolder = "/";
+  }
+  slot->lastUsed = ++clientTick;
+  return *slot;
+
+} // clientContext()
+
+
+FSmanager::ListCacheEntry* FSmanager::findListCache(const std::string &folder)
+{
+  for (ListCacheEntry &entry : listCache)
+  {
+    if (entry.valid && entry.generation == listGeneration && entry.folder == folder)
+    {
+      entry.lastUsed = ++listCacheTick;
+      return &entry;
+    }
+  }
+  return nullptr;
+
+} // findListCache()
+
+
+FSmanager::ListCacheEntry* FSmanager::claimListCache(const std::string &folder)
+{
+  // Reuse a stale or the least recently used entry
+  ListCacheEntry* victim = &listCache[0];
+  for (ListCacheEntry &entry : listCache)
+  {
+    if (!entry.valid || entry.generation != listGeneration)
+    {
+      victim = &entry;
+      break;
+    }
+    if (entry.lastUsed < victim->lastUsed) victim = &entry;
+  }
+  victim->valid = false;
+  victim->folder = folder;
+  victim->json.clear();
+  victim->lastUsed = ++listCacheTick;
+  return victim;
+
+} // claimListCache()
+
+
+#if FSMANAGER_ENABLE_DELETE
+void FSmanager::handleDelete()
+{
+  if (!server->hasArg("file")) 
+  {
+    server->send(400, "text/plain", "Missing file parameter");
+    return;
+  }
+  
+  FSPath path;
+  if (!path.set(server->arg("file").c_str()) || path.isRoot())
+  {
+    server->send(400, "text/plain", "Invalid file parameter");
+    return;
+  }
+
+  const char* message = "";
+  int code = deleteFile(path, message);
+  server->send(code, "text/plain", message);
+
+} // handleDelete()
+#endif // FSMANAGER_ENABLE_DELETE
+
+
+#if FSMANAGER_HAS_DELETE_FILE
+int FSmanager::deleteFile(const FSPath &filename, const char* &message)
+{
+  // Check if it's a system file
+  if (isSystemFile(filename.c_str()))
+  {
+    message = "Cannot delete system file";
+    return 403;
+  }
+  
+  size_t fileSize = existingFileSize(filename.c_str());
+
+  if (LittleFS.remove(filename.c_str()))
+  {
+    adjustUsedSpace(fileSize, 0);
+    invalidateListings();
+    FSM_LOG_D("FSmanager::Deleted file: %s", filename.c_str());
+    message = "File deleted successfully";
+    return 200;
+  }
+
+  FSM_LOG_E("FSmanager::Failed to delete file: %s", filename.c_str());
+  message = "Failed to delete file";
+  return 500;
+
+} // deleteFile()
+#endif // FSMANAGER_HAS_DELETE_FILE
+
+
+//=====================================================================
+// Content types
+//
+//  The built-in table is sorted by extension and searched with a binary
+//  search on the lower-cased extension, types added with addMimeType()
+//  are checked first. Images and fonts may be cached for a day, other
+//  types are revalidated. Archives and binaries are never shown inline.
+//=====================================================================
+
+static constexpr FSmanager::MimeType builtinMimeTypes[] = {
+  { "avif",  "image/avif",               "max-age=86400", true  },
+  { "bin",   "application/octet-stream", "no-cache",      false },
+  { "bmp",   "image/bmp",                "max-age=86400", true  },
+  { "css",   "text/css",                 "no-cache",      true  },
+  { "csv",   "text/csv",                 "no-cache",      true  },
+  { "gif",   "image/gif",                "max-age=86400", true  },
+  { "gz",    "application/gzip",         "no-cache",      false },
+  { "htm",   "text/html",                "no-cache",      true  },
+  { "html",  "text/html",                "no-cache",      true  },
+  { "ico",   "image/x-icon",             "max-age=86400", true  },
+  { "jpeg",  "image/jpeg",               "max-age=86400", true  },
+  { "jpg",   "image/jpeg",               "max-age=86400", true  },
+  { "js",    "application/javascript",   "no-cache",      true  },
+  { "json",  "application/json",         "no-cache",      true  },
+  { "map",   "application/json",         "no-cache",      true  },
+  { "mjs",   "application/javascript",   "no-cache",      true  },
+  { "mp3",   "audio/mpeg",               "max-age=86400", true  },
+  { "pdf",   "application/pdf",          "no-cache",      true  },
+  { "png",   "image/png",                "max-age=86400", true  },
+  { "svg",   "image/svg+xml",            "max-age=86400", true  },
+  { "tar",   "application/x-tar",        "no-cache",      false },
+  { "txt",   "text/plain",               "no-cache",      true  },
+  { "wasm",  "application/wasm",         "no-cache",      true  },
+  { "webp",  "image/webp",               "max-age=86400", true  },
+  { "woff",  "font/woff",                "max-age=86400", true  },
+  { "woff2", "font/woff2",               "max-age=86400", true  },
+  { "xml",   "application/xml",          "no-cache",      true  },
+  { "zip",   "application/zip",          "no-cache",      false },
+};
+
+// Type of every file without an extension in the tables
+static constexpr FSmanager::MimeType defaultMimeType = { "", "application/octet-stream", "no-cache", false };
+
+static constexpr size_t builtinMimeCount = sizeof(builtinMimeTypes) / sizeof(builtinMimeTypes[0]);
+
+static constexpr bool mimeLess(const char* a, const char* b)
+{
+  return (*a == *b) ? (*a != '\0' && mimeLess(a + 1, b + 1)) : ((unsigned char)*a < (unsigned char)*b);
+}
+
+static constexpr bool mimeTableSorted(size_t i)
+{
+  return (i >= builtinMimeCount) || (mimeLess(builtinMimeTypes[i - 1].extension, builtinMimeTypes[i].extension) && mimeTableSorted(i + 1));
+}
+
+static_assert(mimeTableSorted(1), "builtinMimeTypes must be sorted by extension");
+
+
+FSmanager::MimeType FSmanager::getMimeType(const char* path) const
+{
+  // Lower-cased extension of the last path component
+  const char* dot = strrchr(path, '.');
+  if (dot == nullptr || strchr(dot, '/') != nullptr) return defaultMimeType;
+  char extension[8];
+  size_t len = 0;
+  for (const char* p = dot + 1; *p != '\0'; p++)
+  {
+    if (len + 1 >= sizeof(extension)) return defaultMimeType;
+    extension[len++] = tolower((unsigned char)*p);
+  }
+  extension[len] = '\0';
+
+  for (const CustomMimeType &custom : customMimeTypes)
+  {
+    if (custom.extension == extension)
+    {
+      return { custom.extension.c_str(), custom.contentType.c_str(), custom.cacheControl.c_str(), custom.inlineDisposition };
+    }
+  }
+
+  size_t low = 0;
+  size_t high = builtinMimeCount;
+  while (low < high)
+  {
+    size_t mid = (low + high) / 2;
+    int cmp = strcmp(extension, builtinMimeTypes[mid].extension);
+    if (cmp == 0) return builtinMimeTypes[mid];
+    if (cmp < 0) high = mid;
+    else         low = mid + 1;
+  }
+  return defaultMimeType;
+
+} // getMimeType()
+
+
+void FSmanager::addMimeType(const char* extension, const char* contentType, const char* cacheControl, bool inlineDisposition)
+{
+  if (extension == nullptr || contentType == nullptr) return;
+  if (*extension == '.') extension++;
+
+  std::string lowered;
+  for (const char* p = extension; *p != '\0'; p++) lowered += (char)tolower((unsigned char)*p);
+  if (lowered.empty() || lowered.length() >= 8)
+  {
+    FSM_LOG_W("FSmanager::addMimeType(): invalid extension [%s]", extension);
+    return;
+  }
+
+  CustomMimeType custom = { lowered, contentType, (cacheControl != nullptr) ? cacheControl : "no-cache", inlineDisposition };
+  for (CustomMimeType &existing : customMimeTypes)
+  {
+    if (existing.extension == lowered)
+    {
+      existing = custom;
+      return;
+    }
+  }
+  customMimeTypes.push_back(custom);
+
+} // addMimeType()
+
+
+File FSmanager::openForServing(const FSPath &path, bool &gzipped)
+{
+  // Prefer a precompressed sibling when the client accepts gzip, and
+  // always use it when only the .gz version exists
+  FSPath gzPath = path;
+  bool hasGzPath = gzPath.appendSuffix(".gz");
+  bool acceptsGzip = (strstr(server->header("Accept-Encoding").c_str(), "gzip") != nullptr);
+
+  gzipped = false;
+  if (hasGzPath && (acceptsGzip || !LittleFS.exists(path.c_str())) && LittleFS.exists(gzPath.c_str()))
+  {
+    gzipped = true;
+    return openFile(gzPath.c_str(), "r");
+  }
+  return openFile(path.c_str(), "r");
+
+} // openForServing()
+
+
+void FSmanager::sendFile(File &file, const char* contentType, const char* cacheControl, bool gzipped)
+{
+  // Validators are derived from the file size and modification time.
+  // Without timestamps (ESP8266 without a time callback) every file has
+  // mtime 0, the listing generation and boot nonce stand in for it.
+  char etag[40];
+  char lastModified[32] = "";
+  time_t mtime = file.getLastWrite();
+  if (mtime > 0)
+  {
+    snprintf(etag, sizeof(etag), "\"%x-%lx\"", (unsigned)file.size(), (unsigned long)mtime);
+    struct tm tmUtc;
+    gmtime_r(&mtime, &tmUtc);
+    strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tmUtc);
+  }
+  else
+  {
+    snprintf(etag, sizeof(etag), "\"%x-g%x-%x\"", (unsigned)file.size(), (unsigned)bootNonce, (unsigned)listGeneration);
+  }
+
+  server->sendHeader("ETag", etag);
+  if (lastModified[0] != '\0') server->sendHeader("Last-Modified", lastModified);
+  server->sendHeader("Vary", "Accept-Encoding");
+  if (cacheControl != nullptr && cacheControl[0] != '\0') server->sendHeader("Cache-Control", cacheControl);
+
+  // If-None-Match takes precedence, If-Modified-Since is only checked without it.
+  // Browsers echo the Last-Modified value verbatim, so a string compare is enough.
+  bool notModified;
+  if (server->hasHeader("If-None-Match") && server->header("If-None-Match").length() > 0)
+  {
+    notModified = (server->header("If-None-Match") == etag);
+  }
+  else
+  {
+    notModified = (lastModified[0] != '\0' && server->header("If-Modified-Since") == lastModified);
+  }
+
+  if (notModified)
+  {
+    server->send(304);
+    return;
+  }
+
+  server->sendHeader("Accept-Ranges", "bytes");
+  if (gzipped) server->sendHeader("Content-Encoding", "gzip");
+
+  // A Range is only honoured when If-Range (if present) still matches this file
+  if (server->hasHeader("Range") && server->header("Range").length() > 0)
+  {
+    bool rangeValid = true;
+    if (server->hasHeader("If-Range") && server->header("If-Range").length() > 0)
+    {
+      String ifRange = server->header("If-Range");
+      rangeValid = (ifRange == etag) || (lastModified[0] != '\0' && ifRange == lastModified);
+    }
+    if (rangeValid)
+    {
+      sendFileRange(file, contentType, server->header("Range").c_str());
+      return;
+    }
+  }
+
+  // streamFile() adds Content-Encoding: gzip for any ".gz" name (unless the
+  // type is application/x-gzip or octet-stream). A downloaded .gz file is
+  // sent as it is, the browser would otherwise unpack it while saving.
+  if (gzipped || String(file.name()).endsWith(".gz"))
+  {
+    server->setContentLength(file.size());
+    server->send(200, contentType, "");
+    sendFileBody(file, file.size());
+    return;
+  }
+
+  size_t sent = server->streamFile(file, contentType);
+  FSM_STAT(statBytesOut += sent);
+  (void)sent;
+
+} // sendFile()
+
+
+void FSmanager::sendFileBody(File &file, size_t length)
+{
+#if FSMANAGER_ASYNC
+  // The server reads the file itself whenever the client can take more
+  server->streamBody(file, length);
+  FSM_STAT(statBytesOut += length);
+#else
+  // Copy length bytes from the current position through the fixed chunk buffer
+  while (length > 0)
+  {
+    size_t want = (length < sizeof(chunkBuffer)) ? length : sizeof(chunkBuffer);
+    size_t got  = file.read((uint8_t*)chunkBuffer, want);
+    if (got == 0) break;
+    server->sendContent(chunkBuffer, got);
+    FSM_STAT(statBytesOut += got);
+    length -= got;
+  }
+#endif
+
+} // sendFileBody()
+
+
+bool FSmanager::parseRange(const char* header, size_t fileSize, size_t &start, size_t &end)
+{
+  // Only a single range is supported: "bytes=a-b", "bytes=a-" or "bytes=-n"
+  if (strncmp(header, "bytes=", 6) != 0) return false;
+  const char* spec = header + 6;
+  if (strchr(spec, ',') != nullptr) return false;
+
+  const char* dash = strchr(spec, '-');
+  if (dash == nullptr) return false;
+
+  char* parseEnd;
+  if (dash == spec)
+  {
+    // Suffix range, the last n bytes
+    size_t suffix = strtoul(dash + 1, &parseEnd, 10);
+    if (parseEnd == dash + 1) return false;
+    if (suffix > fileSize) suffix = fileSize;
+    start = fileSize - suffix;
+    end   = fileSize - 1;
+  }
+  else
+  {
+    start = strtoul(spec, &parseEnd, 10);
+    if (parseEnd != dash) return false;
+    if (*(dash + 1) == '\0')
+    {
+      end = fileSize - 1;
+    }
+    else
+    {
+      end = strtoul(dash + 1, &parseEnd, 10);
+      if (*parseEnd != '\0') return false;
+      if (end >= fileSize) end = fileSize - 1;
+    }
+  }
+  return true;
+
+} // parseRange()
+
+
+void FSmanager::sendFileRange(File &file, const char* contentType, const char* rangeHeader)
+{
+  size_t fileSize = file.size();
+  size_t start = 0;
+  size_t end   = 0;
+  char contentRange[48];
+
+  if (!parseRange(rangeHeader, fileSize, start, end))
+  {
+    // Malformed or multiple ranges: ignore the header and send the whole
+    // file. Not through streamFile(), which would add a second
+    // Content-Encoding to a gzipped sibling (see sendFile()).
+    server->setContentLength(fileSize);
+    server->send(200, contentType, "");
+    sendFileBody(file, fileSize);
+    return;
+  }
+
+  if (fileSize == 0 || start > end || start >= fileSize || !file.seek(start, SeekSet))
+  {
+    snprintf(contentRange, sizeof(contentRange), "bytes */%u", (unsigned)fileSize);
+    server->sendHeader("Content-Range", contentRange);
+    server->send(416, "text/plain", "Range Not Satisfiable");
+    return;
+  }
+
+  size_t remaining = end - start + 1;
+  snprintf(contentRange, sizeof(contentRange), "bytes %u-%u/%u", (unsigned)start, (unsigned)end, (unsigned)fileSize);
+  FSM_LOG_D("FSmanager::sendFileRange(): %s", contentRange);
+
+  server->sendHeader("Content-Range", contentRange);
+  server->setContentLength(remaining);
+  server->send(206, contentType, "");
+
+  // Copy only the requested window
+  sendFileBody(file, remaining);
+
+} // sendFileRange()
+
+
+void FSmanager::serveSystemFile(const FSPath &path, const std::string &cacheControl)
+{
+  bool gzipped;
+  File file = openForServing(path, gzipped);
+  if (!file || file.isDirectory())
+  {
+    server->send(404, "text/plain", "File not found");
+    return;
+  }
+  // The type decides the Cache-Control unless addSystemFile() was given one,
+  // and whether the browser saves the file instead of showing it
+  MimeType type = getMimeType(path.c_str());
+  if (!type.inlineDisposition) server->sendHeader("Content-Disposition", String("attachment; filename=") + path.name());
+  sendFile(file, type.contentType, cacheControl.empty() ? type.cacheControl : cacheControl.c_str(), gzipped);
+  file.close();
+
+} // serveSystemFile()
+
+
+void FSmanager::handleDownload()
+{
+  if (!server->hasArg("file")) 
+  {
+    server->send(400, "text/plain", "Missing file parameter");
+    return;
+  }
+  
+  FSPath filename;
+  if (!filename.set(server->arg("file").c_str()) || filename.isRoot())
+  {
+    server->send(400, "text/plain", "Invalid file parameter");
+    return;
+  }
+  FSM_LOG_D("FSmanager::Download request for file: %s", filename.c_str());
+  
+  bool gzipped;
+  File file = openForServing(filename, gzipped);
+  if (!file)
+  {
+    server->send(404, "text/plain", "File not found");
+    return;
+  }
+  
+  // Just the filename without path for Content-Disposition, "inline=1"
+  // lets the browser show the types that allow it instead of saving them
+  MimeType type = getMimeType(filename.c_str());
+  bool showInline = type.inlineDisposition && server->arg("inline") == "1";
+  server->sendHeader("Content-Disposition", String(showInline ? "inline; filename=" : "attachment; filename=") + filename.name());
+  uint32_t startTime = millis();
+  size_t fileSize = file.size();
+  sendFile(file, type.contentType, "no-cache", gzipped);
+  file.close();
+
+  uint32_t elapsed = millis() - startTime;
+  FSM_LOG_D("FSmanager::Download of %u bytes took %u ms (%u B/s)"
+           , (unsigned)fileSize, (unsigned)elapsed
+           , (unsigned)(elapsed > 0 ? (uint64_t)fileSize * 1000 / elapsed : 0));
+}
+
+#if FSMANAGER_HAS_UPLOADS
+size_t FSmanager::roundToBlocks(size_t bytes)
+{
+  return ((bytes + fsBlockSize - 1) / fsBlockSize) * fsBlockSize;
+
+} // roundToBlocks()
+
+
+bool FSmanager::hasSpaceFor(size_t bytes, size_t &availableSpace)
+{
+  // LittleFS allocates whole blocks, plus (at least) one block of metadata
+  size_t totalSpace = getTotalSpace();
+  size_t usedSpace = getUsedSpace();
+  availableSpace = (totalSpace > usedSpace) ? (totalSpace - usedSpace) : 0;
+  return (roundToBlocks(bytes) + fsBlockSize) <= availableSpace;
+
+} // hasSpaceFor()
+
+
+#if FSMANAGER_ENABLE_UPLOAD
+void FSmanager::handleCheckSpace()
+{
+  if (!server->hasArg("size")) 
+  {
+    server->send(400, "text/plain", "Missing size parameter");
+    return;
+  }
+  
+  size_t requestedSize = atoi(server->arg("size").c_str());
+  size_t availableSpace;
+  bool fits = hasSpaceFor(requestedSize, availableSpace);
+  
+  FSM_LOG_D("FSmanager::Check space request: size=%u, available=%u", (unsigned)requestedSize, (unsigned)availableSpace);
+  
+  if (!fits)
+  {
+    server->send(413, "text/plain", "Not enough space");
+    return;
+  }
+  
+  server->send(200, "text/plain", "Space available");
+}
+#endif // FSMANAGER_ENABLE_UPLOAD
+
+
+uint64_t FSmanager::connectionKey()
+{
+#if FSMANAGER_ASYNC
+  // Requests are received side by side, the request object is the key
+  return (uintptr_t)server->request();
+#else
+  // Address and port of the connection the request arrived on. The ESP32
+  // WebServer returns the client by value, a copy works on both cores.
+  WiFiClient client = server->client();
+  return ((uint64_t)(uint32_t)client.remoteIP() << 16) | client.remotePort();
+#endif
+
+} // connectionKey()
+
+
+bool FSmanager::findUploadContext()
+{
+  uint64_t connection = connectionKey();
+  uploadCtx = nullptr;
+  for (UploadContext &context : uploadContexts)
+  {
+    if (context.connection == connection)
+    {
+      uploadCtx = &context;
+      uploadCtx->lastActivity = millis();
+      return true;
+    }
+  }
+  return false;
+
+} // findUploadContext()
+
+
+#if FSMANAGER_STATS
+uint32_t FSmanager::takeUploadMicros()
+{
+  // Time the upload callbacks of the current request have spent, read
+  // before its done handler releases the context
+  uint64_t connection = connectionKey();
+  for (UploadContext &context : uploadContexts)
+  {
+    if (context.connection != connection) continue;
+    uint32_t spent = context.statMicros;
+    context.statMicros = 0;
+    return spent;
+  }
+  return 0;
+
+} // takeUploadMicros()
+#endif
+
+
+bool FSmanager::claimUploadContext()
+{
+  // A free context, else one whose upload stalled
+  uint32_t now = millis();
+  UploadContext* slot = &uploadContexts[0];
+  for (UploadContext &context : uploadContexts)
+  {
+    if (context.connection == 0)
+    {
+      slot = &context;
+      break;
+    }
+    if ((now - context.lastActivity) > (now - slot->lastActivity)) slot = &context;
+  }
+  uploadCtx = slot;
+  if (slot->connection != 0)
+  {
+    if ((now - slot->lastActivity) < FSMANAGER_UPLOAD_IDLE_TIMEOUT)
+    {
+      // The response is sent by the done handler of the request
+      uploadCtx = nullptr;
+      refusedConnection = connectionKey();
+      FSM_LOG_W("FSmanager::Upload refused, %d uploads running", FSMANAGER_UPLOAD_CONTEXTS);
+      return false;
+    }
+    FSM_LOG_W("FSmanager::Upload idle for %u ms, dropped", (unsigned)(now - slot->lastActivity));
+    failUpload(408, "Upload failed: Timed out");
+    releaseUploadContext();
+    uploadCtx = slot;
+  }
+
+  slot->connection = connectionKey();
+  slot->lastActivity = now;
+  return true;
+
+} // claimUploadContext()
+
+
+void FSmanager::releaseUploadContext()
+{
+  // Data of a file that was not committed is removed
+  if (uploadCtx->file) uploadCtx->file.close();
+  releaseUploadBuffer();
+  if (!uploadCtx->tempPath.empty()) LittleFS.remove(uploadCtx->tempPath.c_str());
+#if FSMANAGER_ENABLE_EXTRACT
+  if (uploadCtx->tar.active) endExtract();
+#endif
+  *uploadCtx = UploadContext();
+  uploadCtx = nullptr;
+
+} // releaseUploadContext()
+
+
+void FSmanager::failUpload(int code, const char* reason)
+{
+  // The first reason is the one reported to the client
+  if (uploadCtx->success)
+  {
+    uploadCtx->errorCode = code;
+    uploadCtx->error = reason;
+  }
+  uploadCtx->success = false;
+  FSM_LOG_E("FSmanager::Upload failed: %s", reason);
+
+  if (uploadCtx->file) uploadCtx->file.close();
+  releaseUploadBuffer();
+  if (!uploadCtx->tempPath.empty()) LittleFS.remove(uploadCtx->tempPath.c_str());
+  uploadCtx->tempPath.clear();
+
+  // The part that was being received is reported, the next part of a
+  // multi-file upload starts clean
+  if (!uploadCtx->partName.empty())
+  {
+    reportUploadPart(code, 0, reason);
+    uploadCtx->partName.clear();
+  }
+
+#if FSMANAGER_ENABLE_EXTRACT
+  // Entries that were extracted before the failure stay in place
+  if (uploadCtx->tar.active)
+  {
+    if (!uploadCtx->tar.entryName.empty()) reportTarEntry(uploadCtx->errorCode, uploadCtx->error.c_str());
+    endExtract();
+  }
+#endif
+
+} // failUpload()
+
+
+void FSmanager::reportUploadPart(int code, size_t size, const char* message)
+{
+  if (code == 200) uploadCtx->uploadedFiles++;
+  else             uploadCtx->failedFiles++;
+
+  char entry[48];
+  snprintf(entry, sizeof(entry), "%s{\"status\":%d,\"size\":%u,\"name\":\""
+                               , uploadCtx->report.empty() ? "" : ",", code, (unsigned)size);
+  uploadCtx->report += entry;
+  for (char c : uploadCtx->partName)
+  {
+    if (c == '"' || c == '\\') uploadCtx->report += '\\';
+    if ((unsigned char)c >= 0x20) uploadCtx->report += c;
+  }
+  uploadCtx->report += "\",\"message\":\"";
+  uploadCtx->report += message;
+  uploadCtx->report += "\"}";
+
+} // reportUploadPart()
+
+
+#if FSMANAGER_ENABLE_UPLOAD
+void FSmanager::handleUpload()
+{
+  HTTPUpload& upload = server->upload();
+
+  // The state of the request lives in a context of its own, claimed by
+  // the first part, so uploads of other clients do not interfere
+  bool firstPart = false;
+  if (!findUploadContext())
+  {
+    // Parts of a request that was turned away are dropped
+    if (upload.status != UPLOAD_FILE_START || !claimUploadContext()) return;
+    firstPart = true;
+  }
+  
+  if (upload.status == UPLOAD_FILE_START)
+  {
+    // A multipart body can hold many files, they are received one after
+    // the other and every part gets its own entry in the report
+    uploadCtx->tempPath.clear();
+    uploadCtx->partName = upload.filename.c_str();
+
+    if (firstPart)
+    {
+      // Get the target folder from the request or use the client's current folder if not specified
+      bool folderValid = server->hasArg("folder") ? uploadCtx->folder.set(server->arg("folder").c_str(), true)
+                                                  : uploadCtx->folder.set(clientContext().currentFolder.c_str(), true);
+      if (!folderValid)
+      {
+        uploadCtx->rejected = true;
+        failUpload(400, "Upload failed: Invalid folder");
+        return;
+      }
+
+      // Admission check before the first write, once for all parts. The request
+      // Content-Length (multipart overhead included) is an upper bound for the
+      // file sizes. Old files stay until their part is committed, so they are
+      // not credited.
+      size_t contentLength = atoi(server->header("Content-Length").c_str());
+      size_t availableSpace;
+      if (contentLength > 0 && !hasSpaceFor(contentLength, availableSpace))
+      {
+        char reason[96];
+        snprintf(reason, sizeof(reason), "Upload failed: Insufficient storage space (%u bytes needed, %u available)"
+                                       , (unsigned)(roundToBlocks(contentLength) + fsBlockSize), (unsigned)availableSpace);
+        uploadCtx->rejected = true;
+        failUpload(507, reason);
+        return;
+      }
+    }
+    else if (uploadCtx->rejected)
+    {
+      failUpload(uploadCtx->errorCode, uploadCtx->error.c_str());
+      return;
+    }
+    FSM_LOG_I("FSmanager::Upload started: %s%s", uploadCtx->folder.c_str(), upload.filename.c_str());
+    
+    // An archive is unpacked into the upload folder while it arrives
+    if (server->arg("extract") == "tar")
+    {
+      uploadCtx->partName.clear();
+#if FSMANAGER_ENABLE_EXTRACT
+      beginExtract();
+#else
+      failUpload(501, "Upload failed: Archive extraction is not enabled");
+#endif
+      return;
+    }
+
+    // Create the full path, a body the client compressed (every part of a
+    // request with ?compressed=gzip) is stored as "<name>.gz". The form field
+    // "gzip" is only seen by the synchronous WebServer: the async server adds
+    // a part's field name to its params after the part has been received.
+    // The name must be a single valid name, with room for the ".part" suffix.
+    FSPath filepath = uploadCtx->folder;
+    FSPath tempPath;
+    bool nameValid = filepath.append(upload.filename.c_str()) && (filepath.depth() == uploadCtx->folder.depth() + 1);
+    uploadCtx->plainPath.clear();
+    if (nameValid && (server->arg("compressed") == "gzip" || upload.name == "gzip"))
+    {
+      uploadCtx->plainPath = filepath.c_str();
+      nameValid = filepath.appendSuffix(".gz");
+    }
+    tempPath = filepath;
+    if (!nameValid || !tempPath.appendSuffix(".part"))
+    {
+      failUpload(400, "Upload failed: Invalid or too long file name");
+      return;
+    }
+    uploadCtx->targetPath = filepath.c_str();
+
+    // Remember the size of a file that is about to be overwritten
+    uploadCtx->replacedSize = existingFileSize(filepath.c_str());
+
+    // Data goes to a temporary file, the target is only replaced on success
+    uploadCtx->tempPath = tempPath.c_str();
+    uploadCtx->file = openFile(uploadCtx->tempPath.c_str(), "w");
+    if (!uploadCtx->file)
+    {
+      uploadCtx->tempPath.clear();
+      failUpload(500, "Upload failed: Cannot create file");
+      return;
+    }
+    allocUploadBuffer();
+    uploadCtx->writeCalls = 0;
+    uploadCtx->startTime = millis();
+  }
+  else if (upload.status == UPLOAD_FILE_WRITE)
+  {
+    FSM_STAT(statBytesIn += upload.currentSize);
+#if FSMANAGER_ENABLE_EXTRACT
+    if (uploadCtx->tar.active)
+    {
+      // Listings are invalidated once per piece of the archive
+      holdInvalidation();
+      extractTarData(upload.buf, upload.currentSize);
+      releaseInvalidation();
+    }
+    else
+#endif
+    if (uploadCtx->file)
+    {
+      if (!writeUploadData(upload.buf, upload.currentSize))
+      {
+        failUpload(507, "Upload failed: Insufficient storage space (write failed)");
+      }
+    }
+  }
+  else if (upload.status == UPLOAD_FILE_END)
+  {
+#if FSMANAGER_ENABLE_EXTRACT
+    if (uploadCtx->tar.active)
+    {
+      // An entry that is cut off means the archive is incomplete
+      if (uploadCtx->tar.dataLeft > 0 || uploadCtx->tar.headerFill > 0)
+      {
+        failUpload(422, "Upload failed: Truncated tar archive");
+        return;
+      }
+      endExtract();
+      FSM_LOG_I("FSmanager::Archive extracted: %d entries, %d skipped", uploadCtx->tar.extracted, uploadCtx->tar.skipped);
+    }
+    else
+#endif
+    if (uploadCtx->file)
+    {
+      // Write the tail that did not fill a whole block
+      if (!flushUploadBuffer())
+      {
+        failUpload(507, "Upload failed: Insufficient storage space (write failed)");
+        return;
+      }
+      uploadCtx->file.close();
+      size_t bufferSize = (uploadCtx->buffer != nullptr) ? uploadBufferSize : 0;
+      releaseUploadBuffer();
+
+      // Commit: move the temporary file over the target
+      if (!commitTempFile(uploadCtx->tempPath, uploadCtx->targetPath))
+      {
+        failUpload(500, "Upload failed: Cannot replace file");
+        return;
+      }
+      uploadCtx->tempPath.clear();
+
+      adjustUsedSpace(uploadCtx->replacedSize, upload.totalSize);
+      removePlainSibling();
+      invalidateListings();
+      reportUploadPart(200, upload.totalSize, "Uploaded");
+      uploadCtx->partName.clear();
+
+      uint32_t elapsed = millis() - uploadCtx->startTime;
+      FSM_LOG_I("FSmanager::Upload complete: %u bytes", (unsigned)upload.totalSize);
+      FSM_LOG_D("FSmanager::Upload took %u ms (%u B/s), %u write calls, buffer %u bytes"
+               , (unsigned)elapsed
+               , (unsigned)(elapsed > 0 ? (uint64_t)upload.totalSize * 1000 / elapsed : 0)
+               , (unsigned)uploadCtx->writeCalls
+               , (unsigned)bufferSize);
+    }
+  }
+  else if (upload.status == UPLOAD_FILE_ABORTED)
+  {
+    // Connection dropped, the target file is left untouched
+    failUpload(500, "Upload failed: Upload aborted");
+    releaseUploadContext();
+  }
+}
+
+
+
+void FSmanager::handleUploadDone()
+{
+  if (!findUploadContext())
+  {
+    if (refusedConnection != 0 && refusedConnection == connectionKey())
+    {
+      refusedConnection = 0;
+      server->sendHeader("Retry-After", "5");
+      server->send(503, "application/json", "{\"success\":false,\"error\":\"Upload failed: Too many uploads running\",\"uploaded\":0,\"failed\":0,\"files\":[]}");
+      return;
+    }
+    server->send(400, "application/json", "{\"success\":false,\"error\":\"Upload failed: No file in request\",\"uploaded\":0,\"failed\":0,\"files\":[]}");
+    return;
+  }
+
+#if FSMANAGER_ENABLE_EXTRACT
+  if (server->arg("extract") == "tar")
+  {
+    // Per-entry report, also when the archive failed part way
+    std::string json = "{\"success\":";
+    json += uploadCtx->success ? "true" : "false";
+    if (!uploadCtx->success) json += ",\"error\":\"" + uploadCtx->error + "\"";
+    char counts[48];
+    snprintf(counts, sizeof(counts), ",\"extracted\":%d,\"skipped\":%d,\"entries\":["
+                                   , uploadCtx->tar.extracted, uploadCtx->tar.skipped);
+    json += counts + uploadCtx->tar.report + "]}";
+    server->send(uploadCtx->success ? 200 : uploadCtx->errorCode, "application/json", json.c_str());
+  }
+  else
+#endif
+  {
+    // One entry per file part, the status is that of the first failure
+    std::string json = "{\"success\":";
+    json += uploadCtx->success ? "true" : "false";
+    if (!uploadCtx->success) json += ",\"error\":\"" + uploadCtx->error + "\"";
+    char counts[48];
+    snprintf(counts, sizeof(counts), ",\"uploaded\":%d,\"failed\":%d,\"files\":[", uploadCtx->uploadedFiles, uploadCtx->failedFiles);
+    json += counts + uploadCtx->report + "]}";
+    server->send(uploadCtx->success ? 200 : uploadCtx->errorCode, "application/json", json.c_str());
+  }
+  releaseUploadContext();
+
+} // handleUploadDone()
+#endif // FSMANAGER_ENABLE_UPLOAD
+#endif // FSMANAGER_HAS_UPLOADS
+
+
+size_t FSmanager::existingFileSize(const std::string &path)
+{
+  size_t size = 0;
+  File file = openFile(path.c_str(), "r");
+  if (file)
+  {
+    if (!file.isDirectory()) size = file.size();
+    file.close();
+  }
+  return size;
+
+} // existingFileSize()
+
+
+#if FSMANAGER_HAS_UPLOADS
+bool FSmanager::commitTempFile(const std::string &tempPath, const std::string &targetPath)
+{
+  // LittleFS replaces an existing target on rename, a VFS layer may refuse
+  if (LittleFS.rename(tempPath.c_str(), targetPath.c_str())) return true;
+  LittleFS.remove(targetPath.c_str());
+  return LittleFS.rename(tempPath.c_str(), targetPath.c_str());
+
+} // commitTempFile()
+#endif // FSMANAGER_HAS_UPLOADS
+
+
+void FSmanager::setUploadBufferSize(size_t size)
+{
+#if FSMANAGER_HAS_UPLOADS
+  uploadBufferSize = size;
+#else
+  (void)size;
+#endif
+
+} // setUploadBufferSize()
+
+
+#if FSMANAGER_HAS_UPLOADS
+void FSmanager::allocUploadBuffer()
+{
+  releaseUploadBuffer();
+  uploadCtx->bufferUsed = 0;
+  if (uploadBufferSize == 0) return;  // Coalescing disabled, write every chunk
+
+  // Without memory for the buffer the upload still works, chunk by chunk
+  uploadCtx->buffer = (uint8_t*)malloc(uploadBufferSize);
+  if (uploadCtx->buffer == nullptr) FSM_LOG_D("FSmanager::No memory for a %u byte upload buffer", (unsigned)uploadBufferSize);
+
+} // allocUploadBuffer()
+
+
+void FSmanager::releaseUploadBuffer()
+{
+  free(uploadCtx->buffer);
+  uploadCtx->buffer = nullptr;
+  uploadCtx->bufferUsed = 0;
+
+} // releaseUploadBuffer()
+
+
+bool FSmanager::writeUploadData(const uint8_t* data, size_t len)
+{
+  if (uploadCtx->buffer == nullptr)
+  {
+    uploadCtx->writeCalls++;
+    return (uploadCtx->file.write(data, len) == len);
+  }
+
+  // Collect chunks and only pass whole buffers (blocks) to LittleFS
+  while (len > 0)
+  {
+    size_t room = uploadBufferSize - uploadCtx->bufferUsed;
+    size_t part = (len < room) ? len : room;
+    memcpy(uploadCtx->buffer + uploadCtx->bufferUsed, data, part);
+    uploadCtx->bufferUsed += part;
+    data             += part;
+    len              -= part;
+    if (uploadCtx->bufferUsed == uploadBufferSize && !flushUploadBuffer()) return false;
+  }
+  return true;
+
+} // writeUploadData()
+
+
+bool FSmanager::flushUploadBuffer()
+{
+  if (uploadCtx->buffer == nullptr || uploadCtx->bufferUsed == 0) return true;
+  uploadCtx->writeCalls++;
+  size_t written = uploadCtx->file.write(uploadCtx->buffer, uploadCtx->bufferUsed);
+  bool complete = (written == uploadCtx->bufferUsed);
+  uploadCtx->bufferUsed = 0;
+  return complete;
+
+} // flushUploadBuffer()
+#endif // FSMANAGER_HAS_UPLOADS
+
+
+#if FSMANAGER_ENABLE_EXTRACT
+//=====================================================================
+// Tar archive uploads
+//
+//  POST /fsm/upload?extract=tar   (multipart, one .tar file part)
+//
+//  The archive is parsed block by block as the upload chunks arrive,
+//  every file entry is written to "<path>.part" and committed on its own.
+//=====================================================================
+
+void FSmanager::beginExtract()
+{
+  uploadCtx->tar.active     = true;
+  uploadCtx->tar.ended      = false;
+  uploadCtx->tar.headerFill = 0;
+  uploadCtx->tar.dataLeft   = 0;
+  uploadCtx->tar.padLeft    = 0;
+  uploadCtx->tar.writing    = false;
+  uploadCtx->tar.zeroBlocks = 0;
+  uploadCtx->tar.entryName.clear();
+  uploadCtx->writeCalls = 0;
+  uploadCtx->startTime = millis();
+  FSM_LOG_D("FSmanager::Extracting archive into [%s]", uploadCtx->folder.c_str());
+
+} // beginExtract()
+
+
+void FSmanager::endExtract()
+{
+  uploadCtx->tar.active = false;
+
+} // endExtract()
+
+
+bool FSmanager::extractTarData(const uint8_t* data, size_t len)
+{
+  while (len > 0 && uploadCtx->success)
+  {
+    // Data of the current entry
+    if (uploadCtx->tar.dataLeft > 0)
+    {
+      size_t part = (len < uploadCtx->tar.dataLeft) ? len : uploadCtx->tar.dataLeft;
+      if (uploadCtx->tar.writing && !writeUploadData(data, part))
+      {
+        failUpload(507, "Upload failed: Insufficient storage space (write failed)");
+        return false;
+      }
+      data += part;
+      len  -= part;
+      uploadCtx->tar.dataLeft -= part;
+      if (uploadCtx->tar.dataLeft == 0 && !finishTarEntry()) return false;
+      continue;
+    }
+
+    // Padding after the data, and anything after the end-of-archive blocks
+    if (uploadCtx->tar.padLeft > 0 || uploadCtx->tar.ended)
+    {
+      size_t part = uploadCtx->tar.ended ? len : ((len < uploadCtx->tar.padLeft) ? len : uploadCtx->tar.padLeft);
+      if (!uploadCtx->tar.ended) uploadCtx->tar.padLeft -= part;
+      data += part;
+      len  -= part;
+      continue;
+    }
+
+    // Collect the next 512 byte header, it may span upload chunks
+    size_t part = sizeof(uploadCtx->tar.header) - uploadCtx->tar.headerFill;
+    if (part > len) part = len;
+    memcpy(uploadCtx->tar.header + uploadCtx->tar.headerFill, data, part);
+    uploadCtx->tar.headerFill += part;
+    data += part;
+    len  -= part;
+    if (uploadCtx->tar.headerFill == sizeof(uploadCtx->tar.header))
+    {
+      uploadCtx->tar.headerFill = 0;
+      if (!startTarEntry()) return false;
+    }
+  }
+  return uploadCtx->success;
+
+} // extractTarData()
+
+
+static size_t parseTarOctal(const uint8_t* field, size_t len)
+{
+  size_t value = 0;
+  for (size_t i = 0; i < len && field[i] >= '0' && field[i] <= '7'; i++) value = (value << 3) + (field[i] - '0');
+  return value;
+
+} // parseTarOctal()
+
+
+bool FSmanager::startTarEntry()
+{
+  const uint8_t* h = uploadCtx->tar.header;
+  uploadCtx->tar.entryName.clear();
+  uploadCtx->tar.entrySize = 0;
+
+  // Two zero blocks end the archive
+  bool allZero = true;
+  for (size_t i = 0; i < sizeof(uploadCtx->tar.header) && allZero; i++) allZero = (h[i] == 0);
+  if (allZero)
+  {
+    if (++uploadCtx->tar.zeroBlocks == 2) uploadCtx->tar.ended = true;
+    return true;
+  }
+  uploadCtx->tar.zeroBlocks = 0;
+
+  // The device cannot inflate, a .tar.gz has to be unpacked by the client
+  if (h[0] == 0x1f && h[1] == 0x8b)
+  {
+    failUpload(415, "Upload failed: Compressed archives are not supported, send a plain tar");
+    return false;
+  }
+
+  // Checksum counts the checksum field as spaces
+  size_t checksum = 0;
+  for (size_t i = 0; i < sizeof(uploadCtx->tar.header); i++) checksum += (i >= 148 && i < 156) ? ' ' : h[i];
+  if (checksum != parseTarOctal(h + 148, 8))
+  {
+    failUpload(422, "Upload failed: Not a valid tar archive");
+    return false;
+  }
+
+  uploadCtx->tar.entrySize = parseTarOctal(h + 124, 12);
+  uploadCtx->tar.dataLeft  = uploadCtx->tar.entrySize;
+  uploadCtx->tar.padLeft   = (512 - (uploadCtx->tar.entrySize % 512)) % 512;
+  uploadCtx->tar.writing   = false;
+
+  // ustar keeps long names as "prefix/name"
+  if (memcmp(h + 257, "ustar", 5) == 0 && h[345] != 0)
+  {
+    uploadCtx->tar.entryName.assign((const char*)h + 345, strnlen((const char*)h + 345, 155));
+    uploadCtx->tar.entryName += "/";
+  }
+  uploadCtx->tar.entryName.append((const char*)h, strnlen((const char*)h, 100));
+
+  char type = (char)h[156];
+  bool isDir = (type == '5') || (!uploadCtx->tar.entryName.empty() && uploadCtx->tar.entryName.back() == '/');
+  bool isFile = !isDir && (type == '0' || type == '\0' || type == '7');
+
+  // Links, devices and pax/GNU extension records are skipped with their data
+  if (!isDir && !isFile)
+  {
+    if (type != 'x' && type != 'g')
+    {
+      uploadCtx->tar.skipped++;
+      reportTarEntry(415, "Unsupported entry type");
+    }
+    return true;
+  }
+
+  // Entries must stay inside the upload folder
+  FSPath path = uploadCtx->folder;
+  FSPath tempPath;
+  bool pathValid = path.append(uploadCtx->tar.entryName.c_str(), isDir) && (path.depth() > uploadCtx->folder.depth());
+  tempPath = path;
+  if (!pathValid || (!isDir && !tempPath.appendSuffix(".part")))
+  {
+    uploadCtx->tar.skipped++;
+    reportTarEntry(400, "Invalid path");
+    return true;
+  }
+
+  FSM_LOG_D("FSmanager::Archive entry [%s] %u bytes", path.c_str(), (unsigned)uploadCtx->tar.entrySize);
+
+  if (isDir)
+  {
+    if (!makeParentFolders(path))
+    {
+      uploadCtx->tar.skipped++;
+      reportTarEntry(500, "Failed to create folder");
+      return true;
+    }
+    uploadCtx->tar.extracted++;
+    reportTarEntry(200, "Folder created");
+    return true;
+  }
+
+  if (!makeParentFolders(path))
+  {
+    uploadCtx->tar.skipped++;
+    reportTarEntry(500, "Failed to create folder");
+    return true;
+  }
+
+  // Same commit scheme as a single upload
+  uploadCtx->targetPath = path.c_str();
+  uploadCtx->replacedSize = existingFileSize(path.c_str());
+  uploadCtx->tempPath = tempPath.c_str();
+  uploadCtx->file = openFile(uploadCtx->tempPath.c_str(), "w");
+  if (!uploadCtx->file)
+  {
+    uploadCtx->tempPath.clear();
+    uploadCtx->tar.skipped++;
+    reportTarEntry(500, "Cannot create file");
+    return true;
+  }
+  allocUploadBuffer();
+  uploadCtx->tar.writing = true;
+
+  if (uploadCtx->tar.dataLeft == 0) return finishTarEntry();
+  return true;
+
+} // startTarEntry()
+
+
+bool FSmanager::finishTarEntry()
+{
+  if (!uploadCtx->tar.writing) return true;
+  uploadCtx->tar.writing = false;
+
+  if (!flushUploadBuffer())
+  {
+    failUpload(507, "Upload failed: Insufficient storage space (write failed)");
+    return false;
+  }
+  uploadCtx->file.close();
+  releaseUploadBuffer();
+
+  if (!commitTempFile(uploadCtx->tempPath, uploadCtx->targetPath))
+  {
+    LittleFS.remove(uploadCtx->tempPath.c_str());
+    uploadCtx->tempPath.clear();
+    uploadCtx->tar.skipped++;
+    reportTarEntry(500, "Cannot replace file");
+    return true;
+  }
+  uploadCtx->tempPath.clear();
+
+  adjustUsedSpace(uploadCtx->replacedSize, uploadCtx->tar.entrySize);
+  invalidateListings();
+  uploadCtx->tar.extracted++;
+  reportTarEntry(200, "Extracted");
+  FSM_YIELD();
+  return true;
+
+} // finishTarEntry()
+
+
+void FSmanager::reportTarEntry(int code, const char* message)
+{
+  char entry[48];
+  snprintf(entry, sizeof(entry), "%s{\"status\":%d,\"size\":%u,\"name\":\""
+                               , uploadCtx->tar.report.empty() ? "" : ","
+                               , code, (unsigned)uploadCtx->tar.entrySize);
+  uploadCtx->tar.report += entry;
+  for (char c : uploadCtx->tar.entryName)
+  {
+    if (c == '"' || c == '\\') uploadCtx->tar.report += '\\';
+    if ((unsigned char)c >= 0x20) uploadCtx->tar.report += c;
+  }
+  uploadCtx->tar.report += "\",\"message\":\"";
+  uploadCtx->tar.report += message;
+  uploadCtx->tar.report += "\"}";
+
+} // reportTarEntry()
+#endif // FSMANAGER_ENABLE_EXTRACT
+
+
+#if FSMANAGER_ENABLE_CHUNKED
+//=====================================================================
+// Resumable chunked uploads
+//
+//  POST /fsm/chunked/start   file=<path>&size=<bytes>[&chunkSize=<bytes>]
+//  POST /fsm/chunked/chunk?id=<id>&offset=<bytes>&crc=<crc32 hex>  (multipart)
+//  GET  /fsm/chunked/status  id=<id>
+//  POST /fsm/chunked/commit  id=<id>
+//  POST /fsm/chunked/cancel  id=<id>
+//=====================================================================
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len)
+{
+  // Nibble table CRC-32 (IEEE 802.3), call with crc = 0xFFFFFFFF and invert the result
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  while (len--)
+  {
+    crc ^= *data++;
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return crc;
+
+} // crc32Update()
+
+
+FSmanager::UploadSession* FSmanager::findUploadSession(const String &idArg)
+{
+  uint32_t id = strtoul(idArg.c_str(), nullptr, 16);
+  if (id == 0) return nullptr;
+  for (UploadSession &session : uploadSessions)
+  {
+    if (session.id == id) return &session;
+  }
+  return nullptr;
+
+} // findUploadSession()
+
+
+void FSmanager::closeUploadSession(UploadSession &session, bool removeData)
+{
+  // A chunk of this session that is still being received fails
+  UploadContext* current = uploadCtx;
+  for (UploadContext &context : uploadContexts)
+  {
+    if (context.connection == 0 || context.session != &session) continue;
+    uploadCtx = &context;
+    failUpload(410, "Upload session closed");
+    context.session = nullptr;
+  }
+  uploadCtx = current;
+
+  if (removeData)
+  {
+    std::string tempPath = session.targetPath + ".part";
+    LittleFS.remove(tempPath.c_str());
+  }
+  session.id = 0;
+  session.targetPath.clear();
+  session.received.clear();
+  session.received.shrink_to_fit();
+
+} // closeUploadSession()
+
+
+size_t FSmanager::receivedChunks(const UploadSession &session)
+{
+  size_t count = 0;
+  for (uint8_t bits : session.received)
+  {
+    for (; bits; bits &= bits - 1) count++;
+  }
+  return count;
+
+} // receivedChunks()
+
+
+void FSmanager::sendSessionInfo(const UploadSession &session)
+{
+  char json[128];
+  size_t chunks = (session.size + session.chunkSize - 1) / session.chunkSize;
+  snprintf(json, sizeof(json), "{\"id\":\"%08x\",\"size\":%u,\"chunkSize\":%u,\"chunks\":%u,\"received\":%u}"
+                             , (unsigned)session.id, (unsigned)session.size, (unsigned)session.chunkSize
+                             , (unsigned)chunks, (unsigned)receivedChunks(session));
+  server->send(200, "application/json", json);
+
+} // sendSessionInfo()
+
+
+void FSmanager::handleChunkedStart()
+{
+  if (!server->hasArg("file") || !server->hasArg("size"))
+  {
+    server->send(400, "text/plain", "Missing file or size parameter");
+    return;
+  }
+
+  FSPath filepath;
+  FSPath tempPath;
+  bool pathValid = filepath.set(server->arg("file").c_str()) && !filepath.isRoot();
+  tempPath = filepath;
+  if (!pathValid || !tempPath.appendSuffix(".part"))
+  {
+    server->send(400, "text/plain", "Invalid file parameter");
+    return;
+  }
+  if (isSystemFile(filepath.c_str()))
+  {
+    server->send(403, "text/plain", "Cannot overwrite system file");
+    return;
+  }
+
+  size_t size = strtoul(server->arg("size").c_str(), nullptr, 10);
+  size_t chunkSize = FSMANAGER_UPLOAD_CHUNK_SIZE;
+  if (server->hasArg("chunkSize")) chunkSize = strtoul(server->arg("chunkSize").c_str(), nullptr, 10);
+  if (size == 0 || chunkSize < 512 || chunkSize > 65536)
+  {
+    server->send(400, "text/plain", "Invalid size or chunkSize");
+    return;
+  }
+
+  // The same file and size again: resume the existing session
+  UploadSession* slot = nullptr;
+  for (UploadSession &session : uploadSessions)
+  {
+    if (session.id != 0 && session.targetPath == filepath.c_str())
+    {
+      if (session.size == size && session.chunkSize == chunkSize)
+      {
+        session.lastActivity = millis();
+        sendSessionInfo(session);
+        return;
+      }
+      closeUploadSession(session, true);  // Different file behind the same name
+    }
+  }
+
+  size_t availableSpace;
+  if (!hasSpaceFor(size, availableSpace))
+  {
+    char reason[96];
+    snprintf(reason, sizeof(reason), "Insufficient storage space (%u bytes needed, %u available)"
+                                   , (unsigned)(roundToBlocks(size) + fsBlockSize), (unsigned)availableSpace);
+    server->send(507, "text/plain", reason);
+    return;
+  }
+
+  // Use a free slot, or drop the session that was idle the longest
+  for (UploadSession &session : uploadSessions)
+  {
+    if (session.id == 0) { slot = &session; break; }
+    if (slot == nullptr || (millis() - session.lastActivity) > (millis() - slot->lastActivity)) slot = &session;
+  }
+  if (slot->id != 0)
+  {
+    FSM_LOG_D("FSmanager::Dropping upload session for [%s]", slot->targetPath.c_str());
+    closeUploadSession(*slot, true);
+  }
+
+  File file = openFile(tempPath.c_str(), "w");
+  if (!file)
+  {
+    server->send(500, "text/plain", "Cannot create file");
+    return;
+  }
+  file.close();
+
+  // Ids are not guessable from the previous one and never 0
+  static uint32_t sessionCounter = 0;
+  uint32_t id;
+  bool inUse;
+  do
+  {
+    id = (micros() * 2654435761u) ^ (++sessionCounter << 16);
+    inUse = false;
+    for (const UploadSession &session : uploadSessions) inUse |= (session.id == id);
+  } while (id == 0 || inUse);
+
+  slot->id           = id;
+  slot->targetPath   = filepath.c_str();
+  slot->size         = size;
+  slot->chunkSize    = chunkSize;
+  slot->lastActivity = millis();
+  slot->received.assign(((size + chunkSize - 1) / chunkSize + 7) / 8, 0);
+
+  FSM_LOG_D("FSmanager::Upload session %08x for [%s], %u bytes", (unsigned)id, filepath.c_str(), (unsigned)size);
+  sendSessionInfo(*slot);
+
+} // handleChunkedStart()
+
+
+void FSmanager::handleChunkedData()
+{
+  HTTPUpload& upload = server->upload();
+
+  // Each chunk request gets its own context, like a multipart upload
+  if (!findUploadContext())
+  {
+    if (upload.status != UPLOAD_FILE_START || !claimUploadContext()) return;
+  }
+
+  if (upload.status == UPLOAD_FILE_START)
+  {
+    // tempPath stays empty, failUpload() must keep the partial data
+    uploadCtx->session = findUploadSession(server->arg("id"));
+    if (uploadCtx->session == nullptr)
+    {
+      failUpload(404, "Unknown upload session");
+      return;
+    }
+    uploadCtx->offset = strtoul(server->arg("offset").c_str(), nullptr, 10);
+    uploadCtx->expectedCrc = strtoul(server->arg("crc").c_str(), nullptr, 16);
+    if ((uploadCtx->offset % uploadCtx->session->chunkSize) != 0 || uploadCtx->offset >= uploadCtx->session->size)
+    {
+      failUpload(400, "Invalid chunk offset");
+      return;
+    }
+
+    // The chunk is rewritten in place, so it counts as missing until verified
+    size_t index = uploadCtx->offset / uploadCtx->session->chunkSize;
+    uploadCtx->session->received[index / 8] &= ~(1 << (index % 8));
+    uploadCtx->session->lastActivity = millis();
+
+    std::string tempPath = uploadCtx->session->targetPath + ".part";
+    uploadCtx->file = openFile(tempPath.c_str(), "r+");
+    if (!uploadCtx->file || !uploadCtx->file.seek(uploadCtx->offset, SeekSet))
+    {
+      failUpload(500, "Cannot write chunk");
+      return;
+    }
+    uploadCtx->crc = 0xFFFFFFFF;
+    uploadCtx->bytes = 0;
+    allocUploadBuffer();
+  }
+  else if (upload.status == UPLOAD_FILE_WRITE)
+  {
+    FSM_STAT(statBytesIn += upload.currentSize);
+    if (uploadCtx->file && uploadCtx->success)
+    {
+      size_t expected = uploadCtx->session->size - uploadCtx->offset;
+      if (expected > uploadCtx->session->chunkSize) expected = uploadCtx->session->chunkSize;
+      if (uploadCtx->bytes + upload.currentSize > expected)
+      {
+        failUpload(413, "Chunk too large");
+        return;
+      }
+      uploadCtx->crc = crc32Update(uploadCtx->crc, upload.buf, upload.currentSize);
+      uploadCtx->bytes += upload.currentSize;
+      if (!writeUploadData(upload.buf, upload.currentSize))
+      {
+        failUpload(507, "Insufficient storage space (write failed)");
+      }
+    }
+  }
+  else if (upload.status == UPLOAD_FILE_END)
+  {
+    if (uploadCtx->file && uploadCtx->success)
+    {
+      bool written = flushUploadBuffer();
+      uploadCtx->file.close();
+      releaseUploadBuffer();
+
+      size_t expected = uploadCtx->session->size - uploadCtx->offset;
+      if (expected > uploadCtx->session->chunkSize) expected = uploadCtx->session->chunkSize;
+      if (!written)
+      {
+        failUpload(507, "Insufficient storage space (write failed)");
+      }
+      else if (uploadCtx->bytes != expected || ~uploadCtx->crc != uploadCtx->expectedCrc)
+      {
+        failUpload(422, "Chunk length or CRC mismatch");
+      }
+      else
+      {
+        size_t index = uploadCtx->offset / uploadCtx->session->chunkSize;
+        uploadCtx->session->received[index / 8] |= (1 << (index % 8));
+      }
+    }
+  }
+  else if (upload.status == UPLOAD_FILE_ABORTED)
+  {
+    failUpload(500, "Chunk upload aborted");
+    releaseUploadContext();
+  }
+
+} // handleChunkedData()
+
+
+void FSmanager::handleChunkedChunk()
+{
+  if (!findUploadContext())
+  {
+    if (refusedConnection != 0 && refusedConnection == connectionKey())
+    {
+      refusedConnection = 0;
+      server->sendHeader("Retry-After", "5");
+      server->send(503, "text/plain", "Too many uploads running");
+      return;
+    }
+    server->send(400, "text/plain", "No chunk data received");
+    return;
+  }
+
+  if (!uploadCtx->success)
+  {
+    server->send(uploadCtx->errorCode, "text/plain", uploadCtx->error.c_str());
+  }
+  else if (uploadCtx->session == nullptr)
+  {
+    server->send(400, "text/plain", "No chunk data received");
+  }
+  else
+  {
+    sendSessionInfo(*uploadCtx->session);
+  }
+  releaseUploadContext();
+
+} // handleChunkedChunk()
+
+
+void FSmanager::handleChunkedStatus()
+{
+  UploadSession* session = findUploadSession(server->arg("id"));
+  if (session == nullptr)
+  {
+    server->send(404, "text/plain", "Unknown upload session");
+    return;
+  }
+  session->lastActivity = millis();
+
+  // Both lists can be long for a big file, so they are streamed
+  char numBuf[48];
+  size_t chunks = (session->size + session->chunkSize - 1) / session->chunkSize;
+  beginChunkedResponse(200, "application/json");
+  snprintf(numBuf, sizeof(numBuf), "{\"id\":\"%08x\",\"size\":%u", (unsigned)session->id, (unsigned)session->size);
+  sendChunk(numBuf);
+  snprintf(numBuf, sizeof(numBuf), ",\"chunkSize\":%u,\"received\":[", (unsigned)session->chunkSize);
+  sendChunk(numBuf);
+  for (int pass = 0; pass < 2; pass++)
+  {
+    bool wanted = (pass == 0);
+    bool first = true;
+    if (pass == 1) sendChunk("],\"missing\":[");
+    for (size_t index = 0; index < chunks; index++)
+    {
+      bool isReceived = session->received[index / 8] & (1 << (index % 8));
+      if (isReceived != wanted) continue;
+      snprintf(numBuf, sizeof(numBuf), first ? "%u" : ",%u", (unsigned)(index * session->chunkSize));
+      sendChunk(numBuf);
+      first = false;
+    }
+  }
+  sendChunk("]}");
+  endChunkedResponse();
+
+} // handleChunkedStatus()
+
+
+void FSmanager::handleChunkedCommit()
+{
+  UploadSession* session = findUploadSession(server->arg("id"));
+  if (session == nullptr)
+  {
+    server->send(404, "text/plain", "Unknown upload session");
+    return;
+  }
+
+  size_t chunks = (session->size + session->chunkSize - 1) / session->chunkSize;
+  if (receivedChunks(*session) != chunks)
+  {
+    server->send(409, "text/plain", "Upload incomplete");
+    return;
+  }
+
+  std::string tempPath = session->targetPath + ".part";
+  size_t replacedSize = existingFileSize(session->targetPath);
+  if (existingFileSize(tempPath) != session->size || !commitTempFile(tempPath, session->targetPath))
+  {
+    server->send(500, "text/plain", "Cannot replace file");
+    return;
+  }
+
+  adjustUsedSpace(replacedSize, session->size);
+  invalidateListings();
+  FSM_LOG_I("FSmanager::Upload complete: %s (%u bytes)", session->targetPath.c_str(), (unsigned)session->size);
+  closeUploadSession(*session, false);
+  server->send(200, "text/plain", "File uploaded successfully");
+
+} // handleChunkedCommit()
+
+
+void FSmanager::handleChunkedCancel()
+{
+  UploadSession* session = findUploadSession(server->arg("id"));
+  if (session == nullptr)
+  {
+    server->send(404, "text/plain", "Unknown upload session");
+    return;
+  }
+  closeUploadSession(*session, true);
+  server->send(200, "text/plain", "Upload cancelled");
+
+} // handleChunkedCancel()
+#endif // FSMANAGER_ENABLE_CHUNKED
+
+
+#if FSMANAGER_ENABLE_UPLOAD
+void FSmanager::removePlainSibling()
+{
+  // After a compressed upload the uncompressed version would shadow it
+  // for clients that do not accept gzip, so it is removed
+  if (uploadCtx->plainPath.empty()) return;
+
+  File plain = openFile(uploadCtx->plainPath.c_str(), "r");
+  if (!plain) return;
+  size_t plainSize = plain.isDirectory() ? 0 : plain.size();
+  bool isDir = plain.isDirectory();
+  plain.close();
+
+  if (!isDir && LittleFS.remove(uploadCtx->plainPath.c_str()))
+  {
+    adjustUsedSpace(plainSize, 0);
+    FSM_LOG_D("FSmanager::Removed [%s], replaced by compressed upload", uploadCtx->plainPath.c_str());
+  }
+
+} // removePlainSibling()
+#endif // FSMANAGER_ENABLE_UPLOAD
+
+
+#if FSMANAGER_ENABLE_FOLDERS
+void FSmanager::handleCreateFolder()
+{
+  if (!server->hasArg("name")) 
+  {
+    FSM_LOG_D("FSmanager::Error: Missing folder name parameter");
+    server->send(400, "text/plain", "Missing folder name parameter");
+    return;
+  }
+  
+  FSPath folderName;
+  if (!folderName.set(server->arg("name").c_str(), true) || folderName.isRoot())
+  {
+    server->send(400, "text/plain", "Invalid folder name");
+    return;
+  }
+
+  const char* message = "";
+  int code = createFolder(folderName, message);
+  server->send(code, "text/plain", message);
+
+} // handleCreateFolder()
+#endif // FSMANAGER_ENABLE_FOLDERS
+
+
+#if FSMANAGER_ENABLE_EXTRACT || FSMANAGER_HAS_FOLDER_OPS
+bool FSmanager::makeParentFolders(const FSPath &path)
+{
+#ifdef ESP32
+  // Create every missing folder on the way to path (a trailing '/' includes path itself)
+  char folder[FSMANAGER_MAX_PATH];
+  for (const char* slash = strchr(path.c_str() + 1, '/'); slash != nullptr; slash = strchr(slash + 1, '/'))
+  {
+    size_t folderLen = slash - path.c_str();
+    memcpy(folder, path.c_str(), folderLen);
+    folder[folderLen] = '\0';
+    if (folderExists(folder)) continue;
+    if (!LittleFS.mkdir(folder)) return false;
+    invalidateListings();
+  }
+  return true;
+#else
+  // ESP8266 LittleFS creates the folders of a file when it is opened for
+  // writing. An empty folder is not kept, a folder path gets the
+  // placeholder that keeps it; the missing folders on the way stay as
+  // long as it is there.
+  if (!path.isFolder() || folderExists(path.c_str())) return true;
+  FSPath placeholder = path;
+  if (!placeholder.append(FOLDER_PLACEHOLDER)) return false;
+  File file = openFile(placeholder.c_str(), "w");
+  if (!file)
+  {
+    FSM_LOG_E("FSmanager::ESP8266: Failed to create folder - could not create %s", placeholder.c_str());
+    return false;
+  }
+  size_t written = file.println("dummy");
+  file.close();
+  adjustUsedSpace(0, written);
+  invalidateListings();
+  return true;
+#endif
+
+} // makeParentFolders()
+#endif // FSMANAGER_ENABLE_EXTRACT || FSMANAGER_HAS_FOLDER_OPS
+
+
+#if FSMANAGER_HAS_FOLDER_OPS
+int FSmanager::createFolder(const FSPath &folderName, const char* &message)
+{
+  // folderName is a canonical folder path, the missing folders on the way
+  // are created as well and an existing folder is not an error
+  FSM_LOG_D("FSmanager::Creating folder request: %s", folderName.c_str());
+
+  if (folderName.depth() < 1 || !folderName.isFolder())
+  {
+    message = "Invalid folder name";
+    return 400;
+  }
+  if (folderExists(folderName.c_str()))
+  {
+    FSM_LOG_D("FSmanager::Folder already exists");
+    message = "Folder already exists";
+    return 200;
+  }
+
+  // The trailing '/' makes makeParentFolders() create the folder itself
+  // (on ESP8266 with the placeholder that keeps it)
+  if (!makeParentFolders(folderName))
+  {
+    FSM_LOG_E("FSmanager::Failed to create folder %s", folderName.c_str());
+    message = "Failed to create folder";
+    return 500;
+  }
+
+  FSM_LOG_D("FSmanager::Folder created successfully");
+  message = "Folder created successfully";
+  return 200;
+
+} // createFolder()
+#endif // FSMANAGER_HAS_FOLDER_OPS
+
+
+#if FSMANAGER_ENABLE_FOLDERS
+void FSmanager::handleDeleteFolder()
+{
+  if (!server->hasArg("folder")) 
+  {
+    server->send(400, "text/plain", "Missing folder parameter");
     return;
   }
   
-  // Write something to the file to ensure it's created
-  file.println("dummy");
-  file.close();
-  
-  // Verify the file was created
-  File checkFile = LittleFS.open(dummyFile.c_str(), "r");
-  if (!checkFile) {
-    debugPort->println("ESP8266: Failed to verify dummy file creation");
-    server->send(500, "text/plain", "Failed to create folder");
+  FSPath folderName;
+  if (!folderName.set(server->arg("folder").c_str(), true) || folderName.isRoot())
+  {
+    server->send(400, "text/plain", "Invalid folder parameter");
+    return;
+  }
+
+  const char* message = "";
+  if (server->arg("recursive") == "1")
+  {
+    size_t removed = 0, kept = 0;
+    int code = deleteFolderTree(folderName, message, removed, kept);
+    char reply[96];
+    snprintf(reply, sizeof(reply), "%s (%u removed, %u kept)", message, (unsigned)removed, (unsigned)kept);
+    server->send(code, "text/plain", reply);
+    return;
+  }
+  int code = deleteFolder(folderName, message);
+  server->send(code, "text/plain", message);
+
+} // handleDeleteFolder()
+#endif // FSMANAGER_ENABLE_FOLDERS
+
+
+#if FSMANAGER_HAS_FOLDER_OPS
+int FSmanager::deleteFolder(const FSPath &folderName, const char* &message)
+{
+  // Only an empty folder is removed, see deleteFolderTree() for the rest
+  FSM_LOG_D("FSmanager::Deleting folder: %s", folderName.c_str());
+  if (!folderExists(folderName.c_str()))
+  {
+    message = "Folder not found";
+    return 404;
+  }
+
+#ifdef ESP32
+  if (!LittleFS.rmdir(folderName.c_str()))
+  {
+    message = "Failed to delete folder (may not be empty)";
+    return 500;
+  }
+#else
+  // A folder holding only the placeholder is empty, LittleFS drops the
+  // folder together with it
+  FSPath placeholder = folderName;
+  bool hasPlaceholder = false;
+  Dir dir = openDirectory(folderName.c_str());
+  while (dir.next())
+  {
+    if (!isFolderPlaceholder(dir.fileName().c_str()))
+    {
+      message = "Cannot delete non-empty folder";
+      return 400;
+    }
+    hasPlaceholder = true;
+  }
+  dir = Dir();
+  if (hasPlaceholder && placeholder.append(FOLDER_PLACEHOLDER))
+  {
+    size_t placeholderSize = existingFileSize(placeholder.c_str());
+    if (LittleFS.remove(placeholder.c_str())) adjustUsedSpace(placeholderSize, 0);
+  }
+  if (LittleFS.exists(folderName.c_str()) && !LittleFS.rmdir(folderName.c_str()))
+  {
+    message = "Failed to delete folder";
+    return 500;
+  }
+#endif
+
+  invalidateListings();
+  message = "Folder deleted successfully";
+  return 200;
+
+} // deleteFolder()
+
+
+int FSmanager::deleteFolderTree(const FSPath &folderName, const char* &message, size_t &removed, size_t &kept)
+{
+  // One walk over the tree: files are removed as they are found, a folder
+  // once everything below it is gone. System files are kept, and with
+  // them the folders they are in.
+  removed = 0;
+  kept = 0;
+  FSM_LOG_D("FSmanager::Deleting folder tree: %s", folderName.c_str());
+  if (isSystemFile(folderName.c_str()))
+  {
+    message = "Cannot delete system folder";
+    return 403;
+  }
+  if (!folderExists(folderName.c_str()))
+  {
+    message = "Folder not found";
+    return 404;
+  }
+
+  bool bounded = false;
+  TreeWalker walker(*this);
+  walker.begin(folderName.c_str());
+  while (walker.next())
+  {
+    const char* path = walker.path();
+    if (walker.isDir() && !walker.leaving())
+    {
+      if (isSystemFile(path))
+      {
+        walker.skipFolder();
+        kept++;
+      }
+      continue;
+    }
+    if (walker.isDir())
+    {
+      // ESP8266 LittleFS may already have dropped the emptied folder
+      if (LittleFS.rmdir(path) || !folderExists(path)) removed++;
+      continue;
+    }
+    if (isSystemFile(path))
+    {
+      kept++;
+      continue;
+    }
+    if (LittleFS.remove(path))
+    {
+      adjustUsedSpace(walker.size(), 0);
+      removed++;
+    }
+    else
+    {
+      kept++;
+    }
+    FSM_YIELD();
+#if FSMANAGER_ASYNC
+    // The network task is not held up by a large tree: the rest is
+    // removed when the client sends the request again
+    if (removed >= FSMANAGER_ASYNC_DELETE_LIMIT)
+    {
+      bounded = true;
+      break;
+    }
+#endif // FSMANAGER_ASYNC
+  }
+  kept += walker.skipped();
+  walker.close();
+
+  if (bounded)
+  {
+    invalidateListings();
+    FSM_LOG_D("FSmanager::Folder tree %s: %u removed, send again to continue", folderName.c_str(), (unsigned)removed);
+    message = "Folder partly deleted, send again to continue";
+    return 202;
+  }
+
+  bool gone = LittleFS.rmdir(folderName.c_str()) || !folderExists(folderName.c_str());
+  if (removed > 0 || gone) invalidateListings();
+  FSM_LOG_D("FSmanager::Folder tree %s: %u removed, %u kept", folderName.c_str(), (unsigned)removed, (unsigned)kept);
+  if (!gone)
+  {
+    message = (kept > 0) ? "Folder partly deleted, protected entries were kept" : "Failed to delete folder";
+    return (kept > 0) ? 403 : 500;
+  }
+  message = "Folder deleted successfully";
+  return 200;
+
+} // deleteFolderTree()
+#endif // FSMANAGER_HAS_FOLDER_OPS
+
+
+#if FSMANAGER_ENABLE_BATCH
+//=====================================================================
+// Batch operations
+//
+//  POST /fsm/batch  body: [{"op":"delete","path":"/a.txt"},
+//                          {"op":"move","from":"/b.txt","to":"/old/b.txt"},
+//                          {"op":"mkdir","path":"/new"},{"op":"rmdir","path":"/old2"},
+//                          {"op":"rmdir","path":"/logs","recursive":"1"}]
+//  (the array may also be wrapped as {"ops":[...]})
+//=====================================================================
+
+static const char* skipJsonSpace(const char* p)
+{
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+  return p;
+
+} // skipJsonSpace()
+
+
+static const char* readJsonString(const char* p, std::string &out)
+{
+  // p points at the opening quote, returns the position after the closing quote
+  out.clear();
+  if (*p != '"') return nullptr;
+  p++;
+  while (*p != '"')
+  {
+    if (*p == '\0') return nullptr;
+    if (*p == '\\')
+    {
+      p++;
+      switch (*p)
+      {
+        case '"':  case '\\': case '/': out += *p; break;
+        case 'n':  out += '\n'; break;
+        case 't':  out += '\t'; break;
+        default:   return nullptr;  // \uXXXX and friends are not used in paths
+      }
+    }
+    else
+    {
+      out += *p;
+    }
+    p++;
+  }
+  return p + 1;
+
+} // readJsonString()
+
+
+void FSmanager::handleBatch()
+{
+  if ((size_t)server->header("Content-Length").toInt() > FSMANAGER_BATCH_MAX_BODY)
+  {
+    server->send(413, "text/plain", "Batch too large");
+    return;
+  }
+  String body = server->arg("plain");
+  FSM_STAT(statBytesIn += body.length());
+  const char* p = strchr(body.c_str(), '[');
+  if (p == nullptr)
+  {
+    server->send(400, "text/plain", "Expected a JSON array of operations");
+    return;
+  }
+
+  // Listing generation and space are settled once, after the last operation
+  holdInvalidation();
+
+  beginChunkedResponse(200, "application/json");
+  sendChunk("{\"results\":[");
+
+  std::string key, value, op, path, from, to, recursive;
+  char entry[48];
+  int index = 0, succeeded = 0, failed = 0;
+  bool parseError = false;
+
+  p = skipJsonSpace(p + 1);
+  while (*p == '{')
+  {
+    // Read one flat object with string values
+    op.clear(); path.clear(); from.clear(); to.clear(); recursive.clear();
+    p = skipJsonSpace(p + 1);
+    while (*p == '"')
+    {
+      p = readJsonString(p, key);
+      if (p == nullptr) break;
+      p = skipJsonSpace(p);
+      if (*p != ':') { p = nullptr; break; }
+      p = readJsonString(skipJsonSpace(p + 1), value);
+      if (p == nullptr) break;
+      if      (key == "op")   op   = value;
+      else if (key == "path") path = value;
+      else if (key == "from") from = value;
+      else if (key == "to")   to   = value;
+      else if (key == "recursive") recursive = value;
+      p = skipJsonSpace(p);
+      if (*p == ',') p = skipJsonSpace(p + 1);
+    }
+    if (p == nullptr || *p != '}')
+    {
+      parseError = true;
+      break;
+    }
+    p = skipJsonSpace(p + 1);
+    if (*p == ',') p = skipJsonSpace(p + 1);
+
+    int code;
+    const char* message = "";
+    bool isFolderOp = (op == "mkdir" || op == "rmdir");
+    FSPath opPath, fromPath, toPath;
+    bool pathValid = opPath.set(path.c_str(), isFolderOp) && !opPath.isRoot();
+    if (op == "move")
+    {
+      fromPath.set(from.c_str());
+      toPath.set(to.c_str());
+      code = moveFile(fromPath, toPath, message);
+    }
+    else if (op != "delete" && !isFolderOp)
+    {
+      code = 400;
+      message = "Unknown operation";
+    }
+    else if (!pathValid)
+    {
+      code = 400;
+      message = "Invalid path";
+    }
+    else if (op == "delete")
+    {
+      code = deleteFile(opPath, message);
+    }
+    else if (op == "mkdir")
+    {
+      code = createFolder(opPath, message);
+    }
+    else if (op == "rmdir" && recursive == "1")
+    {
+      size_t removed, kept;
+      code = deleteFolderTree(opPath, message, removed, kept);
+    }
+    else if (op == "rmdir")
+    {
+      code = deleteFolder(opPath, message);
+    }
+    else
+    {
+      code = 400;
+      message = "Unknown operation";
+    }
+    if (code == 200) succeeded++; else failed++;
+
+    snprintf(entry, sizeof(entry), "%s{\"index\":%d,\"status\":%d,\"message\":\"", (index > 0) ? "," : "", index, code);
+    sendChunk(entry);
+    sendChunk(message);
+    sendChunk("\"}");
+    index++;
+    FSM_YIELD();
+  }
+
+  snprintf(entry, sizeof(entry), "],\"succeeded\":%d,\"failed\":%d", succeeded, failed);
+  sendChunk(entry);
+  if (parseError) sendChunk(",\"error\":\"Malformed operation, batch stopped\"");
+  sendChunk("}");
+  endChunkedResponse();
+
+  releaseInvalidation();
+  FSM_LOG_D("FSmanager::Batch: %d succeeded, %d failed", succeeded, failed);
+
+} // handleBatch()
+
+
+int FSmanager::moveFile(const FSPath &from, const FSPath &to, const char* &message)
+{
+  if (!from.valid() || !to.valid() || from.isRoot() || to.isRoot())
+  {
+    message = "Missing or invalid from or to";
+    return 400;
+  }
+  if (isSystemFile(from.c_str()) || isSystemFile(to.c_str()))
+  {
+    message = "Cannot move system file";
+    return 403;
+  }
+  if (!LittleFS.exists(from.c_str()))
+  {
+    message = "File not found";
+    return 404;
+  }
+
+  // A folder takes everything below it along. Folder rules are stored as
+  // "/dir/", so both ends are also checked in that form.
+  FSPath fromFolder, toFolder;
+  if (fromFolder.set(from.c_str(), true) && toFolder.set(to.c_str(), true)
+      && (isSystemFile(fromFolder.c_str()) || isSystemFile(toFolder.c_str()) || holdsSystemFiles(fromFolder)))
+  {
+    message = "Cannot move folder with system files";
+    return 403;
+  }
+  if (LittleFS.exists(to.c_str()))
+  {
+    message = "Target already exists";
+    return 409;
+  }
+  if (!LittleFS.rename(from.c_str(), to.c_str()))
+  {
+    message = "Failed to move file";
+    return 500;
+  }
+  invalidateListings();
+  FSM_LOG_D("FSmanager::Moved [%s] to [%s]", from.c_str(), to.c_str());
+  message = "File moved successfully";
+  return 200;
+
+} // moveFile()
+
+
+bool FSmanager::holdsSystemFiles(const FSPath &folder)
+{
+  // True when anything below folder is protected, a file is no folder
+  // and holds nothing
+  TreeWalker walker(*this);
+  if (!walker.begin(folder.c_str())) return false;
+  while (walker.next())
+  {
+    if (!walker.leaving() && isSystemFile(walker.path())) return true;
+  }
+  // Entries the walk could not reach are treated as protected
+  return walker.skipped() > 0;
+
+} // holdsSystemFiles()
+#endif // FSMANAGER_ENABLE_BATCH
+
+
+#if FSMANAGER_ENABLE_ARCHIVE
+//=====================================================================
+// Folder archive download
+//
+//  GET /fsm/archive?folder=<folder>   streams the folder as a ustar archive
+//=====================================================================
+
+static bool makeTarHeader(char* header, const std::string &name, bool isDir, size_t size, time_t mtime)
+{
+  memset(header, 0, 512);
+
+  // Names up to 100 characters fit in "name", longer ones are split over
+  // "prefix" (155) and "name" at a '/'
+  size_t nameLen = name.length();
+  if (nameLen <= 100)
+  {
+    memcpy(header, name.c_str(), nameLen);
+  }
+  else
+  {
+    size_t split = name.rfind('/', 155);
+    if (split == std::string::npos || split == 0 || nameLen - split - 1 > 100) return false;
+    memcpy(header + 345, name.c_str(), split);
+    memcpy(header, name.c_str() + split + 1, nameLen - split - 1);
+  }
+
+  snprintf(header + 100, 8, "%07o", isDir ? 0755 : 0644);          // mode
+  snprintf(header + 108, 8, "%07o", 0);                             // uid
+  snprintf(header + 116, 8, "%07o", 0);                             // gid
+  snprintf(header + 124, 12, "%011lo", (unsigned long)size);        // size
+  snprintf(header + 136, 12, "%011lo", (unsigned long)mtime);       // mtime
+  header[156] = isDir ? '5' : '0';                                  // typeflag
+  memcpy(header + 257, "ustar", 6);                                 // magic
+  memcpy(header + 263, "00", 2);                                    // version
+
+  // Checksum is calculated with the checksum field filled with spaces
+  memset(header + 148, ' ', 8);
+  unsigned int checksum = 0;
+  for (size_t i = 0; i < 512; i++) checksum += (uint8_t)header[i];
+  snprintf(header + 148, 8, "%06o", checksum);
+  header[155] = ' ';
+  return true;
+
+} // makeTarHeader()
+
+
+bool FSmanager::sendTarHeader(const std::string &name, bool isDir, size_t size, time_t mtime)
+{
+  char header[512];
+  if (!makeTarHeader(header, name, isDir, size, mtime)) return false;
+  sendChunk(header, sizeof(header));
+  return true;
+
+} // sendTarHeader()
+
+
+void FSmanager::handleArchive()
+{
+  FSPath folderPath;
+  if (!folderPath.set(server->hasArg("folder") ? server->arg("folder").c_str() : "/", true))
+  {
+    server->send(400, "text/plain", "Invalid folder parameter");
     return;
   }
-  checkFile.close();
-  
-  // IMPORTANT: Do NOT delete the dummy file on ESP8266
-  // This ensures the folder continues to exist
-  if (doDebug) debugPort->println("ESP8266: Folder created successfully");
-  server->send(200, "text/plain", "Folder created successfully");
+  std::string folder = folderPath.c_str();
+
+  if (!folderExists(folder.c_str()))
+  {
+    server->send(404, "text/plain", "Folder not found");
+    return;
+  }
+
+  // Archive is named after the folder, entries are relative to it
+  FSPath archiveName;
+  archiveName.set(folderPath.isRoot() ? "littlefs" : folderPath.c_str());
+  archiveName.appendSuffix(".tar");
+  FSM_LOG_D("FSmanager::Archive of [%s] as [%s]", folder.c_str(), archiveName.c_str());
+
+  server->sendHeader("Content-Disposition", String("attachment; filename=") + archiveName.name());
+
+#if FSMANAGER_ASYNC
+  // The server pulls the archive piece by piece after this returns, the
+  // walk continues where the previous piece stopped
+  std::shared_ptr<ArchiveStream> archive = std::make_shared<ArchiveStream>(*this);
+  archive->folder = folder;
+  archive->walker.begin(folder.c_str());
+  server->streamChunked("application/x-tar", [this, archive](uint8_t* buffer, size_t maxLen) {
+    return this->readArchive(*archive, buffer, maxLen);
+  });
+#else
+  beginChunkedResponse(200, "application/x-tar");
+
+  size_t entries = 0;
+  size_t skipped = 0;
+  walkTree(folder, [&](const std::string &path, bool isDir, size_t size) {
+    if (isFolderPlaceholder(path.c_str())) return;
+    std::string name = path.substr(folder.length());
+    if (isDir)
+    {
+      if (sendTarHeader(name, true, 0, 0)) entries++; else skipped++;
+      return;
+    }
+
+    File file = openFile(path.c_str(), "r");
+    if (!file)
+    {
+      skipped++;
+      return;
+    }
+    if (!sendTarHeader(name, false, size, file.getLastWrite()))
+    {
+      file.close();
+      skipped++;
+      return;
+    }
+
+    // Contents go straight through the chunk buffer, padded to 512 bytes.
+    // If the file shrank while reading, zeros keep the archive consistent.
+    size_t remaining = size + ((512 - (size % 512)) % 512);
+    size_t dataLeft  = size;
+    flushChunk();
+    while (remaining > 0)
+    {
+      size_t part = (remaining < sizeof(chunkBuffer)) ? remaining : sizeof(chunkBuffer);
+      size_t got  = 0;
+      if (dataLeft > 0) got = file.read((uint8_t*)chunkBuffer, (part < dataLeft) ? part : dataLeft);
+      if (got < part) memset(chunkBuffer + got, 0, part - got);
+      dataLeft  -= (got < dataLeft) ? got : dataLeft;
+      chunkLength = part;
+      flushChunk();
+      remaining -= part;
+    }
+    file.close();
+    entries++;
+    FSM_YIELD();
+  });
+
+  // End of archive: two zero blocks
+  char zeros[64];
+  memset(zeros, 0, sizeof(zeros));
+  for (int i = 0; i < 1024 / (int)sizeof(zeros); i++) sendChunk(zeros, sizeof(zeros));
+  endChunkedResponse();
+
+  FSM_LOG_D("FSmanager::Archive done, %u entries, %u skipped", (unsigned)entries, (unsigned)skipped);
+#endif
+
+} // handleArchive()
+
+
+#if FSMANAGER_ASYNC
+size_t FSmanager::readArchive(ArchiveStream &archive, uint8_t* buffer, size_t maxLen)
+{
+  // Same layout as the synchronous archive: per entry a header, the data
+  // and zeros up to the next 512 byte block, two zero blocks at the end
+  size_t filled = 0;
+  while (filled < maxLen)
+  {
+    size_t room = maxLen - filled;
+    if (archive.headerLeft > 0)
+    {
+      size_t part = (room < archive.headerLeft) ? room : archive.headerLeft;
+      memcpy(buffer + filled, archive.header + sizeof(archive.header) - archive.headerLeft, part);
+      archive.headerLeft -= part;
+      filled += part;
+      continue;
+    }
+    if (archive.dataLeft > 0)
+    {
+      // If the file shrank while reading, zeros keep the archive consistent
+      size_t part = (room < archive.dataLeft) ? room : archive.dataLeft;
+      size_t got  = archive.file.read(buffer + filled, part);
+      if (got < part) memset(buffer + filled + got, 0, part - got);
+      archive.dataLeft -= part;
+      filled += part;
+      continue;
+    }
+    if (archive.zerosLeft > 0)
+    {
+      size_t part = (room < archive.zerosLeft) ? room : archive.zerosLeft;
+      memset(buffer + filled, 0, part);
+      archive.zerosLeft -= part;
+      filled += part;
+      continue;
+    }
+    if (archive.file) archive.file.close();
+
+    if (archive.walker.next())
+    {
+      const char* path = archive.walker.path();
+      bool isDir = archive.walker.isDir();
+      if (archive.walker.leaving() || isFolderPlaceholder(path)) continue;
+      size_t size = 0;
+      time_t mtime = 0;
+      if (!isDir)
+      {
+        archive.file = openFile(path, "r");
+        if (!archive.file)
+        {
+          archive.skipped++;
+          continue;
+        }
+        size  = archive.file.size();
+        mtime = archive.file.getLastWrite();
+      }
+      if (!makeTarHeader(archive.header, path + archive.folder.length(), isDir, size, mtime))
+      {
+        if (archive.file) archive.file.close();
+        archive.skipped++;
+        continue;
+      }
+      archive.headerLeft = sizeof(archive.header);
+      archive.dataLeft   = size;
+      archive.zerosLeft  = (512 - (size % 512)) % 512;
+      archive.entries++;
+      continue;
+    }
+
+    if (archive.ended) break;
+    archive.ended = true;
+    archive.skipped += archive.walker.skipped();
+    archive.walker.close();
+    archive.zerosLeft = 1024;
+    FSM_LOG_D("FSmanager::Archive done, %u entries, %u skipped", (unsigned)archive.entries, (unsigned)archive.skipped);
+  }
+  return filled;
+
+} // readArchive()
+#endif // FSMANAGER_ASYNC
+#endif // FSMANAGER_ENABLE_ARCHIVE
+
+
+//=====================================================================
+// Routing
+//
+//  addRoute() registers a handler with the WebServer, or with the
+//  AsyncWebServer (FSMANAGER_ASYNC) through an AsyncRequest that gives
+//  the handler the WebServer interface it is written against.
+//=====================================================================
+
+void FSmanager::addRoute(const char* uri, MethodType method, const std::function<void()> &onRequest, const std::function<void()> &onUpload, size_t maxBody)
+{
+#if FSMANAGER_ASYNC
+  ArUploadHandlerFunction receive = nullptr;
+  if (onUpload)
+  {
+    receive = [this, onUpload](AsyncWebServerRequest* request, const String &filename, size_t index, uint8_t* data, size_t len, bool final) {
+      this->receiveAsyncUpload(request, filename, index, data, len, final, onUpload);
+    };
+  }
+  // The async server hands a JSON body to a body callback instead of the
+  // "plain" argument, it is collected up to maxBody bytes
+  ArBodyHandlerFunction body = nullptr;
+  if (maxBody > 0)
+  {
+    body = [maxBody](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+      receiveAsyncBody(request, data, len, index, total, maxBody);
+    };
+  }
+  webServer->on(uri, method, [this, onRequest](AsyncWebServerRequest* request) { this->handleAsync(request, onRequest); }, receive, body);
+#else
+  // The WebServer keeps the body in the "plain" argument itself
+  (void)maxBody;
+  if (onUpload) webServer->on(uri, method, onRequest, onUpload);
+  else          webServer->on(uri, method, onRequest);
 #endif
+
+} // addRoute()
+
+
+#if FSMANAGER_ASYNC
+void FSmanager::handleAsync(AsyncWebServerRequest* request, const std::function<void()> &handler)
+{
+  // Async callbacks run one at a time in the network task, so server
+  // can point at the request for the duration of the handler
+  AsyncRequest current(request);
+  server = &current;
+  handler();
+  current.finish();
+  server = nullptr;
+
+} // handleAsync()
+
+
+void FSmanager::receiveAsyncUpload(AsyncWebServerRequest* request, const String &filename, size_t index, uint8_t* data, size_t len, bool final, const std::function<void()> &onUpload)
+{
+  // Every file part arrives in pieces, index counts from 0 per part. They
+  // are handed on as the START/WRITE/END calls of the WebServer.
+  AsyncRequest current(request);
+  server = &current;
+  HTTPUpload &upload = current.upload();
+  upload.filename = filename;
+  if (index == 0)
+  {
+    upload.status = UPLOAD_FILE_START;
+    onUpload();
+
+    // A dropped connection ends the upload as UPLOAD_FILE_ABORTED, after the
+    // response has been sent the handler finds no upload left to abort
+    request->onDisconnect([this, request, onUpload]() {
+      AsyncRequest dropped(request);
+      server = &dropped;
+      dropped.upload().status = UPLOAD_FILE_ABORTED;
+      onUpload();
+      server = nullptr;
+    });
+  }
+  if (len > 0)
+  {
+    upload.status      = UPLOAD_FILE_WRITE;
+    upload.buf         = data;
+    upload.currentSize = len;
+    upload.totalSize   = index + len;
+    onUpload();
+  }
+  if (final)
+  {
+    upload.status    = UPLOAD_FILE_END;
+    upload.totalSize = index + len;
+    onUpload();
+  }
+  server = nullptr;
+
+} // receiveAsyncUpload()
+
+
+void FSmanager::receiveAsyncBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total, size_t maxBody)
+{
+  // Collected in the request's _tempObject, which the server frees with
+  // the request. A larger body is not kept, the handler answers 413.
+  if (total > maxBody) return;
+  if (index == 0)
+  {
+    free(request->_tempObject);
+    request->_tempObject = malloc(total + 1);
+    if (request->_tempObject == nullptr) return;
+    ((char*)request->_tempObject)[total] = '\0';
+  }
+  if (request->_tempObject == nullptr || index + len > total) return;
+  memcpy((char*)request->_tempObject + index, data, len);
+
+} // receiveAsyncBody()
+
+
+FSmanager::AsyncRequest::AsyncRequest(AsyncWebServerRequest* request)
+{
+  req = request;
+  stream = nullptr;
+  code = 200;
+  bodyFollows = false;
+  headPending = false;
+  sent = false;
 }
 
 
-void FSmanager::handleDeleteFolder()
+String FSmanager::AsyncRequest::uri() const
 {
-  if (!server->hasArg("folder")) 
+  return req->url();
+
+} // uri()
+
+
+bool FSmanager::AsyncRequest::hasArg(const char* name) const
+{
+  return req->hasArg(name);
+
+} // hasArg()
+
+
+String FSmanager::AsyncRequest::arg(const char* name) const
+{
+  // A body collected by receiveAsyncBody() stands in for "plain"
+  if (strcmp(name, "plain") == 0 && req->_tempObject != nullptr) return String((const char*)req->_tempObject);
+  return req->arg(name);
+
+} // arg()
+
+
+bool FSmanager::AsyncRequest::hasHeader(const char* name) const
+{
+  return req->hasHeader(name);
+
+} // hasHeader()
+
+
+String FSmanager::AsyncRequest::header(const char* name) const
+{
+  // The server parses Content-Length itself
+  if (strcasecmp(name, "Content-Length") == 0) return String((unsigned long)req->contentLength());
+  return req->hasHeader(name) ? req->header(name) : String();
+
+} // header()
+
+
+void FSmanager::AsyncRequest::sendHeader(const char* name, const String &value)
+{
+  headers.emplace_back(String(name), value);
+
+} // sendHeader()
+
+
+void FSmanager::AsyncRequest::setContentLength(size_t length)
+{
+  // The length is known when the response is made, only the intent counts
+  (void)length;
+  bodyFollows = true;
+
+} // setContentLength()
+
+
+void FSmanager::AsyncRequest::send(int code, const char* contentType, const char* content)
+{
+  if (sent || headPending) return;
+  this->code = code;
+  this->contentType = (contentType != nullptr) ? contentType : "";
+  if (bodyFollows && (content == nullptr || content[0] == '\0'))
   {
-    server->send(400, "text/plain", "Missing folder parameter");
+    // Head only, sendContent() or streamBody() supplies the body
+    headPending = true;
     return;
   }
-  
-  std::string folderName = std::string(server->arg("folder").c_str());
-  if (folderName[0] != '/') folderName = "/" + folderName;
-  if (folderName[folderName.length()-1] != '/') folderName += "/";
-  
-  if (doDebug) debugPort->printf("FSmanager::Deleting folder: %s\n", folderName.c_str());
-  
-#ifdef ESP32
-  if (LittleFS.rmdir(folderName.c_str()))
+
+  AsyncWebServerResponse* response = req->beginResponse(code, this->contentType.c_str(), (content != nullptr) ? content : "");
+  addHeaders(response);
+  req->send(response);
+  sent = true;
+
+} // send()
+
+
+void FSmanager::AsyncRequest::sendContent(const char* data, size_t len)
+{
+  // The zero-length chunk that ends a chunked response is not needed
+  if (!headPending || len == 0) return;
+  if (stream == nullptr)
   {
-    server->send(200, "text/plain", "Folder deleted successfully");
+    stream = req->beginResponseStream(contentType.c_str());
+    stream->setCode(code);
+    addHeaders(stream);
   }
-  else
+  stream->write((const uint8_t*)data, len);
+
+} // sendContent()
+
+
+void FSmanager::AsyncRequest::sendContent(const char* text)
+{
+  sendContent(text, strlen(text));
+
+} // sendContent()
+
+
+size_t FSmanager::AsyncRequest::streamFile(File &file, const char* contentType)
+{
+  size_t size = file.size();
+  setContentLength(size);
+  send(200, contentType, "");
+  streamBody(file, size);
+  return size;
+
+} // streamFile()
+
+
+void FSmanager::AsyncRequest::streamBody(File &file, size_t length)
+{
+  if (!headPending || stream != nullptr) return;
+
+  // The response owns the file from here on, the caller's close() does
+  // nothing. Reads continue from the current position (a Range start).
+  File body = file;
+  file = File();
+  AsyncWebServerResponse* response = req->beginResponse(contentType.c_str(), length, [body, length](uint8_t* buffer, size_t maxLen, size_t index) mutable -> size_t {
+    if (index >= length) return 0;
+    size_t want = (maxLen < length - index) ? maxLen : length - index;
+    size_t got  = body.read(buffer, want);
+    if (got < want) memset(buffer + got, 0, want - got);  // File shrank, keep the promised length
+    return want;
+  });
+  response->setCode(code);
+  addHeaders(response);
+  req->send(response);
+  headPending = false;
+  sent = true;
+
+} // streamBody()
+
+
+void FSmanager::AsyncRequest::streamChunked(const char* contentType, const std::function<size_t(uint8_t* buffer, size_t maxLen)> &read)
+{
+  if (sent || headPending) return;
+  AsyncWebServerResponse* response = req->beginChunkedResponse(contentType, [read](uint8_t* buffer, size_t maxLen, size_t) {
+    return read(buffer, maxLen);
+  });
+  addHeaders(response);
+  req->send(response);
+  sent = true;
+
+} // streamChunked()
+
+
+void FSmanager::AsyncRequest::finish()
+{
+  if (stream != nullptr)
+  {
+    req->send(stream);
+    stream = nullptr;
+  }
+  else if (headPending)
+  {
+    // Head without a body, an empty file for instance
+    AsyncWebServerResponse* response = req->beginResponse(code, contentType.c_str(), "");
+    addHeaders(response);
+    req->send(response);
+  }
+  else if (!sent)
   {
-    server->send(500, "text/plain", "Failed to delete folder (may not be empty)");
+    req->send(500, "text/plain", "No response");
   }
+  headPending = false;
+  sent = true;
+
+} // finish()
+
+
+void FSmanager::AsyncRequest::addHeaders(AsyncWebServerResponse* response)
+{
+  for (const std::pair<String, String> &header : headers) response->addHeader(header.first, header.second);
+  headers.clear();
+
+} // addHeaders()
+#endif // FSMANAGER_ASYNC
+
+
+//=====================================================================
+// Instrumentation
+//
+//  GET /fsm/stats[?reset=1]   per-handler counters as JSON
+//
+//  Every registered handler runs through runHandler(). Upload callbacks
+//  (completes = false) add their time to the request, which is counted
+//  once when its completion handler has run.
+//=====================================================================
+
+File FSmanager::openFile(const char* path, const char* mode)
+{
+  FSM_STAT(statFsOpens++);
+  return LittleFS.open(path, mode);
+
+} // openFile()
+
+
+#ifndef ESP32
+Dir FSmanager::openDirectory(const char* path)
+{
+  FSM_STAT(statFsOpens++);
+  return LittleFS.openDir(path);
+
+} // openDirectory()
+#endif
+
+
+void FSmanager::runHandler(StatId id, void (FSmanager::*handler)(), bool completes)
+{
+#if FSMANAGER_STATS
+  StatSnapshot snap;
+  statBegin(snap);
+#if FSMANAGER_HAS_UPLOADS
+  if (completes) snap.uploadMicros = takeUploadMicros();
+#endif
+  (this->*handler)();
+  statEnd(id, snap, completes);
 #else
-  // ESP8266 doesn't have a direct rmdir function
-  // Check if folder is empty first
-  const char* folderNameCStr = folderName.c_str();
-  Dir dir = LittleFS.openDir(folderNameCStr);
-  if (dir.next())
+  (void)id;
+  (void)completes;
+  (this->*handler)();
+#endif
+
+} // runHandler()
+
+
+#if FSMANAGER_STATS
+static uint32_t largestFreeBlock()
+{
+#ifdef ESP32
+  return ESP.getMaxAllocHeap();
+#else
+  return ESP.getMaxFreeBlockSize();
+#endif
+
+} // largestFreeBlock()
+#endif // FSMANAGER_STATS
+
+
+void FSmanager::statBegin(StatSnapshot &snap)
+{
+#if FSMANAGER_STATS
+  snap.heap     = ESP.getFreeHeap();
+  snap.block    = largestFreeBlock();
+  snap.bytesIn  = statBytesIn;
+  snap.bytesOut = statBytesOut;
+  snap.fsOpens  = statFsOpens;
+  snap.uploadMicros = 0;
+  snap.start    = micros();
+#else
+  (void)snap;
+#endif
+
+} // statBegin()
+
+
+void FSmanager::statEnd(StatId id, const StatSnapshot &snap, bool completes)
+{
+#if FSMANAGER_STATS
+  uint32_t elapsed = micros() - snap.start;
+  HandlerStats &stats = handlerStats[id];
+  stats.bytesIn  += statBytesIn - snap.bytesIn;
+  stats.bytesOut += statBytesOut - snap.bytesOut;
+  stats.fsOpens  += statFsOpens - snap.fsOpens;
+
+  // An upload callback only adds to the time of the request it belongs to,
+  // kept in its upload context so requests that overlap do not mix
+  if (!completes)
   {
-    server->send(400, "text/plain", "Cannot delete non-empty folder");
+#if FSMANAGER_HAS_UPLOADS
+    if (uploadCtx != nullptr) uploadCtx->statMicros += elapsed;
+#endif
     return;
   }
-  
-  // Folder is empty, we can "delete" it by just considering it gone
-  server->send(200, "text/plain", "Folder deleted successfully");
+  elapsed += snap.uploadMicros;
+
+  if (stats.calls == 0 || elapsed < stats.minMicros) stats.minMicros = elapsed;
+  if (elapsed > stats.maxMicros) stats.maxMicros = elapsed;
+  stats.totalMicros += elapsed;
+  stats.calls++;
+  stats.heapBefore  = snap.heap;
+  stats.heapAfter   = ESP.getFreeHeap();
+  stats.blockBefore = snap.block;
+  stats.blockAfter  = largestFreeBlock();
+#else
+  (void)id;
+  (void)snap;
+  (void)completes;
 #endif
-}
+
+} // statEnd()
+
+
+size_t FSmanager::getStats(const HandlerStats* &stats) const
+{
+#if FSMANAGER_STATS
+  stats = handlerStats;
+  return STAT_COUNT;
+#else
+  stats = nullptr;
+  return 0;
+#endif
+
+} // getStats()
+
+
+void FSmanager::resetStats()
+{
+#if FSMANAGER_STATS
+  static const char* names[STAT_COUNT] = {
+    "filelist", "delete", "download", "checkSpace", "upload", "chunked", "chunkedControl",
+    "createFolder", "deleteFolder", "batch", "archive", "systemFile", "usedSpace"
+  };
+  for (int i = 0; i < STAT_COUNT; i++)
+  {
+    memset(&handlerStats[i], 0, sizeof(handlerStats[i]));
+    handlerStats[i].name = names[i];
+  }
+  statBytesIn = 0;
+  statBytesOut = 0;
+  statFsOpens = 0;
+#endif
+
+} // resetStats()
+
+
+void FSmanager::handleStats()
+{
+#if FSMANAGER_STATS
+  char entry[320];
+  beginChunkedResponse(200, "application/json");
+  snprintf(entry, sizeof(entry), "{\"uptime\":%lu,\"freeHeap\":%u,\"largestBlock\":%u,\"logDropped\":%u,\"handlers\":["
+                               , (unsigned long)millis(), (unsigned)ESP.getFreeHeap(), (unsigned)largestFreeBlock()
+                               , (unsigned)getDroppedLogLines());
+  sendChunk(entry);
+
+  for (int i = 0; i < STAT_COUNT; i++)
+  {
+    const HandlerStats &stats = handlerStats[i];
+    snprintf(entry, sizeof(entry), "%s{\"name\":\"%s\",\"calls\":%u,\"minUs\":%u,\"avgUs\":%u,\"maxUs\":%u"
+                                   ",\"bytesIn\":%lu,\"bytesOut\":%lu,\"fsOpens\":%u"
+                                   ",\"heapBefore\":%u,\"heapAfter\":%u,\"blockBefore\":%u,\"blockAfter\":%u}"
+                                 , (i > 0) ? "," : "", stats.name, (unsigned)stats.calls
+                                 , (unsigned)stats.minMicros
+                                 , (unsigned)(stats.calls > 0 ? stats.totalMicros / stats.calls : 0)
+                                 , (unsigned)stats.maxMicros
+                                 , (unsigned long)stats.bytesIn, (unsigned long)stats.bytesOut, (unsigned)stats.fsOpens
+                                 , (unsigned)stats.heapBefore, (unsigned)stats.heapAfter
+                                 , (unsigned)stats.blockBefore, (unsigned)stats.blockAfter);
+    sendChunk(entry);
+  }
+  sendChunk("]}");
+  endChunkedResponse();
+
+  if (server->arg("reset") == "1") resetStats();
+#endif
+
+} // handleStats()
+
+
+//=====================================================================
+// Logging: logLine() formats into the ring buffer and never waits for
+// the debug port, drainLog() writes the queued lines from loop() or a
+// low priority task. The reader needs no lock, it only moves the tail.
+// On ESP32 writers on both cores (loop() and the network task) reserve
+// their room under logLock; ESP8266 has one core and logLine() is not
+// called from an interrupt, so its writers never overlap.
+//=====================================================================
+
+#if FSMANAGER_LOG_BUFFER_SIZE > 0
+// The free running head and tail wrap at 2^32, which keeps the offsets
+// right only when the buffer size divides it
+static_assert((FSMANAGER_LOG_BUFFER_SIZE & (FSMANAGER_LOG_BUFFER_SIZE - 1)) == 0,
+              "FSMANAGER_LOG_BUFFER_SIZE must be a power of two");
+#endif
+
+void FSmanager::logLine(const char* format, ...)
+{
+  char line[FSMANAGER_LOG_LINE_SIZE];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line) - 1, format, args);
+  va_end(args);
+  if (length < 0) return;
+  if ((size_t)length > sizeof(line) - 2) length = sizeof(line) - 2;
+  line[length++] = '\n';
+
+#if FSMANAGER_LOG_BUFFER_SIZE > 0
+  // On ESP32 the handlers of the async backend run in the async_tcp task
+  // while the sketch logs from loop(), so writers take turns. The ESP8266
+  // runs every callback in one context.
+#ifdef ESP32
+  portENTER_CRITICAL(&logLock);
+#endif
+  uint32_t head = logHead.load(std::memory_order_relaxed);
+  uint32_t tail = logTail.load(std::memory_order_acquire);
+  if (FSMANAGER_LOG_BUFFER_SIZE - (head - tail) < (uint32_t)length)
+  {
+    logDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+  else
+  {
+    size_t start = head % FSMANAGER_LOG_BUFFER_SIZE;
+    size_t first = std::min((size_t)length, (size_t)FSMANAGER_LOG_BUFFER_SIZE - start);
+    memcpy(logBuffer + start, line, first);
+    memcpy(logBuffer, line + first, length - first);
+    logHead.store(head + length, std::memory_order_release);
+  }
+#ifdef ESP32
+  portEXIT_CRITICAL(&logLock);
+#endif
+#else
+  if (debugPort) debugPort->write((const uint8_t*)line, length);
+#endif
+
+} // logLine()
+
+
+size_t FSmanager::drainLog(size_t maxBytes)
+{
+#if FSMANAGER_LOG_BUFFER_SIZE > 0
+  uint32_t tail = logTail.load(std::memory_order_relaxed);
+  uint32_t head = logHead.load(std::memory_order_acquire);
+  size_t pending = std::min((size_t)(head - tail), maxBytes);
+  if (pending == 0 || debugPort == nullptr) return 0;
+
+  size_t start = tail % FSMANAGER_LOG_BUFFER_SIZE;
+  size_t first = std::min(pending, (size_t)FSMANAGER_LOG_BUFFER_SIZE - start);
+  debugPort->write((const uint8_t*)logBuffer + start, first);
+  if (pending > first) debugPort->write((const uint8_t*)logBuffer, pending - first);
+  logTail.store(tail + pending, std::memory_order_release);
+  return pending;
+#else
+  (void)maxBytes;
+  return 0;
+#endif
+
+} // drainLog()
+
+
+uint32_t FSmanager::getDroppedLogLines() const
+{
+  return logDropped.load(std::memory_order_relaxed);
+
+} // getDroppedLogLines()
 
 
 std::string FSmanager::getCurrentFolder()
 {
-  return currentFolder;
+  // Folder of the client that listed most recently
+  const ClientContext* latest = nullptr;
+  for (const ClientContext &context : clientContexts)
+  {
+    if (context.lastUsed != 0 && (latest == nullptr || context.lastUsed > latest->lastUsed)) latest = &context;
+  }
+  return (latest != nullptr) ? latest->currentFolder : "/";
 }
@@ -4,62 +4,755 @@
 
 #include <Arduino.h>
 #include <string>
-#ifdef ESP32
+
+// 1 serves the endpoints from an ESPAsyncWebServer instead of the blocking
+// WebServer/ESP8266WebServer, requests are then handled outside loop()
+#ifndef FSMANAGER_ASYNC
+  #define FSMANAGER_ASYNC 0
+#endif
+
+#if FSMANAGER_ASYNC
+    #include <ESPAsyncWebServer.h>
+#elif defined(ESP32)
     #include <WebServer.h>
+#else
+    #include <ESP8266WebServer.h>
+#endif
+#ifdef ESP32
     #include <LittleFS.h>
     #include <esp_partition.h>
 #else
-    #include <ESP8266WebServer.h>
     #include <FS.h>
     #include <LittleFS.h>
 #endif
 
+#include <atomic>
 #include <functional>
-#include <set>
-#include <map>
+#include <vector>
 
-#ifdef ESP32
+#if FSMANAGER_ASYNC
+  using WebServerClass = AsyncWebServer;
+  #ifndef CONTENT_LENGTH_UNKNOWN
+    #define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+  #endif
+#elif defined(ESP32)
   using WebServerClass = WebServer;
 #else
   using WebServerClass = ESP8266WebServer;
 #endif
 
+// Size of the buffer used to assemble chunked (streamed) responses
+#ifndef FSMANAGER_CHUNK_SIZE
+  #define FSMANAGER_CHUNK_SIZE 512
+#endif
+
+// LittleFS block size used for space admission (ESP8266 reads it from FSInfo)
+#ifndef FSMANAGER_FS_BLOCK_SIZE
+  #define FSMANAGER_FS_BLOCK_SIZE 4096
+#endif
+
+// Uploads are collected in a buffer of this size (one LittleFS block by
+// default) and written in whole blocks, 0 writes every HTTP chunk directly
+#ifndef FSMANAGER_UPLOAD_BUFFER_SIZE
+  #define FSMANAGER_UPLOAD_BUFFER_SIZE 4096
+#endif
+
+// Number of resumable (chunked) upload sessions that can be open at once
+#ifndef FSMANAGER_UPLOAD_SESSIONS
+  #define FSMANAGER_UPLOAD_SESSIONS 2
+#endif
+
+// Upload requests (multipart or chunk) that can be received at the same
+// time, each holds an open file and an upload buffer while it runs
+#ifndef FSMANAGER_UPLOAD_CONTEXTS
+  #ifdef ESP32
+    #define FSMANAGER_UPLOAD_CONTEXTS 2
+  #else
+    #define FSMANAGER_UPLOAD_CONTEXTS 1
+  #endif
+#endif
+
+// An upload that did not receive data for this long gives up its context
+// to a new upload when all contexts are in use
+#ifndef FSMANAGER_UPLOAD_IDLE_TIMEOUT
+  #define FSMANAGER_UPLOAD_IDLE_TIMEOUT 30000
+#endif
+
+// Clients (by IP address) whose current folder is remembered, the least
+// recently seen client is forgotten first
+#ifndef FSMANAGER_CLIENT_CONTEXTS
+  #define FSMANAGER_CLIENT_CONTEXTS 4
+#endif
+
+// Default chunk size for resumable uploads
+#ifndef FSMANAGER_UPLOAD_CHUNK_SIZE
+  #define FSMANAGER_UPLOAD_CHUNK_SIZE 16384
+#endif
+
+// Number of folder listings kept in the listing cache (at least 1)
+#ifndef FSMANAGER_LIST_CACHE_SIZE
+  #define FSMANAGER_LIST_CACHE_SIZE 4
+#endif
+
+// Listings with a larger JSON body are streamed but not cached
+#ifndef FSMANAGER_LIST_CACHE_MAX_BYTES
+  #define FSMANAGER_LIST_CACHE_MAX_BYTES 2048
+#endif
+
+// Largest page a paged /fsm/filelist request (limit=) may ask for
+#ifndef FSMANAGER_LIST_PAGE_MAX
+  #define FSMANAGER_LIST_PAGE_MAX 200
+#endif
+
+// Largest /fsm/batch request body, a larger one is answered with 413
+#ifndef FSMANAGER_BATCH_MAX_BODY
+  #define FSMANAGER_BATCH_MAX_BODY 4096
+#endif
+
+// Most entries one recursive folder delete removes on the async backend,
+// where it runs in the network task. The answer is then 202 and the
+// client sends the request again for the rest.
+#ifndef FSMANAGER_ASYNC_DELETE_LIMIT
+  #define FSMANAGER_ASYNC_DELETE_LIMIT 64
+#endif
+
+// Longest file or folder name (one path component) LittleFS accepts
+#ifndef FSMANAGER_MAX_NAME
+  #ifdef ESP32
+    #define FSMANAGER_MAX_NAME 63
+  #else
+    #define FSMANAGER_MAX_NAME 32
+  #endif
+#endif
+
+// Longest full path, this is the size of the buffer in FSPath
+#ifndef FSMANAGER_MAX_PATH
+  #define FSMANAGER_MAX_PATH 128
+#endif
+
+// Deepest folder level a tree walk enters, the walk keeps one directory
+// open per level
+#ifndef FSMANAGER_MAX_DEPTH
+  #define FSMANAGER_MAX_DEPTH 16
+#endif
+
+// Canonical absolute path in a fixed buffer: one leading '/', no "//" or
+// "." components, a folder ends in '/', a file does not. Paths with ".."
+// components, control characters or names that are too long are rejected.
+class FSPath
+{
+  public:
+    FSPath();
+    bool set(const char* path, bool asFolder = false);
+    bool append(const char* relative, bool asFolder = false);
+    bool appendSuffix(const char* suffix);
+    void toParent();
+    void clear();
+    const char* c_str() const { return buf; }
+    size_t length() const { return len; }
+    bool valid() const { return len > 0; }
+    bool isRoot() const { return len == 1; }
+    bool isFolder() const { return len > 0 && buf[len - 1] == '/'; }
+    bool endsWith(const char* suffix) const;
+    const char* name() const;
+    int depth() const;
+
+  private:
+    bool fail();
+    char buf[FSMANAGER_MAX_PATH];
+    size_t len;
+};
+
+// Endpoints compiled in and registered by begin(). Set one to 0 to leave
+// its handlers, helpers and buffers out of the build. /fsm/filelist,
+// /fsm/download and /fsm/stats are always present.
+#ifndef FSMANAGER_ENABLE_UPLOAD       // /fsm/upload and /fsm/checkSpace
+  #define FSMANAGER_ENABLE_UPLOAD 1
+#endif
+#ifndef FSMANAGER_ENABLE_EXTRACT      // "/fsm/upload?extract=tar", needs UPLOAD
+  #define FSMANAGER_ENABLE_EXTRACT FSMANAGER_ENABLE_UPLOAD
+#endif
+#ifndef FSMANAGER_ENABLE_CHUNKED      // /fsm/chunked/*
+  #define FSMANAGER_ENABLE_CHUNKED 1
+#endif
+#ifndef FSMANAGER_ENABLE_DELETE       // /fsm/delete
+  #define FSMANAGER_ENABLE_DELETE 1
+#endif
+#ifndef FSMANAGER_ENABLE_FOLDERS      // /fsm/createFolder and /fsm/deleteFolder
+  #define FSMANAGER_ENABLE_FOLDERS 1
+#endif
+#ifndef FSMANAGER_ENABLE_BATCH        // /fsm/batch
+  #define FSMANAGER_ENABLE_BATCH 1
+#endif
+#ifndef FSMANAGER_ENABLE_ARCHIVE      // /fsm/archive
+  #define FSMANAGER_ENABLE_ARCHIVE 1
+#endif
+
+#if FSMANAGER_ENABLE_EXTRACT && !FSMANAGER_ENABLE_UPLOAD
+  #error "FSMANAGER_ENABLE_EXTRACT needs FSMANAGER_ENABLE_UPLOAD"
+#endif
+
+// Code shared by more than one endpoint
+#define FSMANAGER_HAS_UPLOADS     (FSMANAGER_ENABLE_UPLOAD || FSMANAGER_ENABLE_CHUNKED)
+#define FSMANAGER_HAS_DELETE_FILE (FSMANAGER_ENABLE_DELETE || FSMANAGER_ENABLE_BATCH)
+#define FSMANAGER_HAS_FOLDER_OPS  (FSMANAGER_ENABLE_FOLDERS || FSMANAGER_ENABLE_BATCH)
+
+// Log levels for FSMANAGER_LOG_LEVEL, lines above the level compile to nothing
+#define FSMANAGER_LOG_NONE  0
+#define FSMANAGER_LOG_ERROR 1
+#define FSMANAGER_LOG_WARN  2
+#define FSMANAGER_LOG_INFO  3
+#define FSMANAGER_LOG_DEBUG 4
+
+#ifndef FSMANAGER_LOG_LEVEL
+  #ifdef FSMANAGER_DEBUG
+    #define FSMANAGER_LOG_LEVEL FSMANAGER_LOG_DEBUG
+  #else
+    #define FSMANAGER_LOG_LEVEL FSMANAGER_LOG_INFO
+  #endif
+#endif
+
+// Log lines are queued in a ring buffer of this size (a power of two) and
+// written to the debug port by drainLog(), 0 writes every line directly
+#ifndef FSMANAGER_LOG_BUFFER_SIZE
+  #define FSMANAGER_LOG_BUFFER_SIZE 1024
+#endif
+
+// Longer log lines are truncated
+#ifndef FSMANAGER_LOG_LINE_SIZE
+  #define FSMANAGER_LOG_LINE_SIZE 128
+#endif
+
+// Bytes drainLog() writes per call when no limit is given
+#ifndef FSMANAGER_LOG_DRAIN_BYTES
+  #define FSMANAGER_LOG_DRAIN_BYTES 256
+#endif
+
+// Per-handler statistics at /fsm/stats, 0 compiles all instrumentation out
+#ifndef FSMANAGER_STATS
+  #define FSMANAGER_STATS 1
+#endif
+
 class FSmanager
 {
+  private:
+    // Called by walkTree() for every entry, directories end in '/'
+    using WalkCallback = std::function<void(const std::string &path, bool isDir, size_t size)>;
+
+    // Depth-first walk below a folder without recursion, with one open
+    // directory per level on a stack of FSMANAGER_MAX_DEPTH. A folder is
+    // returned on the way in and, with leaving() set, after its contents.
+    class TreeWalker
+    {
+      public:
+        explicit TreeWalker(FSmanager &owner) : owner(owner) {}
+        bool begin(const char* folder);     // folder must end in '/'
+        bool next();
+        void skipFolder() { enterPending = false; }  // Do not enter the folder just returned
+        void close();
+        const char* path() const { return buf; }     // Folders end in '/'
+        bool isDir() const { return dir; }
+        bool leaving() const { return leave; }
+        size_t size() const { return fileSize; }
+        size_t skipped() const { return skippedEntries; }  // Too deep or path too long
+
+      private:
+        bool enter();
+        void pop();
+        FSmanager &owner;
+#ifdef ESP32
+        File levels[FSMANAGER_MAX_DEPTH];
+#else
+        Dir levels[FSMANAGER_MAX_DEPTH];
+#endif
+        size_t levelLen[FSMANAGER_MAX_DEPTH];  // Path length of the folder open at each level
+        int depth = 0;
+        char buf[FSMANAGER_MAX_PATH] = "";
+        size_t len = 0;
+        bool dir = false;
+        bool leave = false;
+        bool enterPending = false;
+        size_t fileSize = 0;
+        size_t skippedEntries = 0;
+    };
+
+#if FSMANAGER_ASYNC
+    using MethodType = WebRequestMethodComposite;
+
+    // Upload callback states and record, named as the synchronous
+    // WebServer has them so the handlers serve both backends
+    enum UploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+    struct HTTPUpload
+    {
+      UploadStatus status = UPLOAD_FILE_START;
+      String filename;
+      String name;                // Form field, the async server does not report it
+      size_t totalSize = 0;
+      size_t currentSize = 0;
+      uint8_t* buf = nullptr;
+    };
+
+    // One async request behind the part of the WebServer interface the
+    // handlers use. The response is built when the handler returns: a
+    // small body that is sent in pieces is collected in an AsyncResponseStream,
+    // file bodies, archives and listings are pulled by the server from a
+    // filler while the client takes the data.
+    class AsyncRequest
+    {
+      public:
+        explicit AsyncRequest(AsyncWebServerRequest* request);
+        AsyncWebServerRequest* request() const { return req; }
+        AsyncClient &client() { return *req->client(); }
+        String uri() const;
+        bool hasArg(const char* name) const;
+        String arg(const char* name) const;
+        bool hasHeader(const char* name) const;
+        String header(const char* name) const;
+        void sendHeader(const char* name, const String &value);
+        void setContentLength(size_t length);
+        void send(int code, const char* contentType = nullptr, const char* content = nullptr);
+        void sendContent(const char* data, size_t len);
+        void sendContent(const char* text);
+        size_t streamFile(File &file, const char* contentType);
+        void streamBody(File &file, size_t length);
+        void streamChunked(const char* contentType, const std::function<size_t(uint8_t* buffer, size_t maxLen)> &read);
+        HTTPUpload &upload() { return uploadRecord; }
+        void finish();
+
+      private:
+        void addHeaders(AsyncWebServerResponse* response);
+        AsyncWebServerRequest* req;
+        std::vector<std::pair<String, String>> headers;  // Set by sendHeader() until the response is made
+        AsyncResponseStream* stream;  // Body collected by sendContent()
+        int code;
+        String contentType;
+        bool bodyFollows;             // setContentLength() called, the body follows send()
+        bool headPending;             // send() with the body still to come
+        bool sent;
+        HTTPUpload uploadRecord;
+    };
+    using RequestClass = AsyncRequest;
+#else
+    using MethodType = HTTPMethod;
+    using RequestClass = WebServerClass;
+#endif
+
+    // Compact record of one directory entry, the name lives in listNames
+    struct ListEntry
+    {
+      uint32_t nameOffset;
+      uint32_t size;      // File size, or number of files for a directory
+      uint32_t originalSize;  // Uncompressed size of a ".gz" file, else 0
+      bool     isDir;
+    };
+
+    // Serialized listing of one folder, valid for a single generation
+    struct ListCacheEntry
+    {
+      std::string folder;         // Folder, with the page appended for paged listings
+      std::string json;
+      uint32_t generation = 0;
+      uint32_t lastUsed = 0;
+      bool valid = false;
+    };
+
+    // Content type added with addMimeType(), checked before the built-in table
+    struct CustomMimeType
+    {
+      std::string extension;
+      std::string contentType;
+      std::string cacheControl;
+      bool inlineDisposition;
+    };
+
+    // Open directory of the last paged listing, so the next page continues
+    // where the previous one stopped instead of enumerating from the start
+    struct ListPager
+    {
+      std::string folder;
+      uint32_t generation = 0;
+      size_t position = 0;        // Index of the entry the handle returns next
+      size_t total = 0;           // Entries in the folder, once counted
+      bool counted = false;       // total is known for this folder and generation
+      bool open = false;
+#ifdef ESP32
+      File dir;
+#else
+      Dir dir;
+#endif
+    };
+
+#if FSMANAGER_ENABLE_CHUNKED
+    // Resumable upload, data is kept in "<targetPath>.part" until committed
+    struct UploadSession
+    {
+      uint32_t id = 0;                // 0 = free slot
+      std::string targetPath;
+      size_t size = 0;
+      size_t chunkSize = 0;
+      std::vector<uint8_t> received;  // One bit per chunk
+      uint32_t lastActivity = 0;
+    };
+#endif
+
+#if FSMANAGER_ENABLE_EXTRACT
+    // Incremental extraction of a tar upload ("/fsm/upload?extract=tar")
+    struct TarExtract
+    {
+      bool active = false;
+      bool ended = false;         // End-of-archive blocks seen
+      uint8_t header[512];
+      size_t headerFill = 0;
+      size_t dataLeft = 0;        // Data bytes of the current entry still to come
+      size_t padLeft = 0;         // Padding up to the next 512 byte block
+      size_t entrySize = 0;
+      bool writing = false;       // Data of the current entry goes to the open file
+      int zeroBlocks = 0;
+      int extracted = 0;
+      int skipped = 0;
+      std::string entryName;
+      std::string report;         // JSON objects, one per entry
+    };
+#endif
+
+    // Browsing state of one client
+    struct ClientContext
+    {
+      uint32_t address = 0;       // IPv4 address of the client
+      std::string currentFolder = "/";
+      uint32_t lastUsed = 0;      // 0 = free slot
+    };
+
+#if FSMANAGER_HAS_UPLOADS
+    // State of one upload request, claimed by its first part and released
+    // when the response is sent
+    struct UploadContext
+    {
+      uint64_t connection = 0;    // Client address and port, 0 = free slot
+      uint32_t lastActivity = 0;
+      FSPath folder;              // Target folder of a multipart upload
+      File file;
+      bool success = true;
+      int errorCode = 200;
+      std::string error;          // Reason reported when success is false
+      bool rejected = false;      // Folder or space check failed for the request
+      std::string partName;       // File part being received, reported when it ends
+      std::string report;         // JSON objects, one per file part
+      int uploadedFiles = 0;
+      int failedFiles = 0;
+      size_t replacedSize = 0;    // Size of the file the upload overwrites
+      std::string plainPath;      // Uncompressed name of a gzip upload, else empty
+      std::string targetPath;     // File the upload replaces when committed
+      std::string tempPath;       // File the upload is written to, "<target>.part"
+      uint8_t* buffer = nullptr;  // Write coalescing buffer, only while a file is open
+      size_t bufferUsed = 0;
+      uint32_t writeCalls = 0;    // LittleFS write() calls for the current file
+      uint32_t startTime = 0;
+#if FSMANAGER_STATS
+      uint32_t statMicros = 0;    // Time of the upload callbacks so far
+#endif
+#if FSMANAGER_ENABLE_EXTRACT
+      TarExtract tar;
+#endif
+#if FSMANAGER_ENABLE_CHUNKED
+      UploadSession* session = nullptr;  // Session of the chunk being received
+      size_t offset = 0;
+      size_t bytes = 0;
+      uint32_t crc = 0;
+      uint32_t expectedCrc = 0;
+#endif
+    };
+#endif
+
+#if FSMANAGER_ASYNC
+    // Listing response the async server pulls piece by piece. It owns the
+    // entries the handler read, their JSON is made as the client takes it.
+    struct ListStream
+    {
+      std::string folder;
+      std::vector<ListEntry> entries;
+      std::vector<char> names;         // '\0' separated entry names
+      size_t next = 0;                 // Entry to format next
+      std::string pending;             // Text made but not sent yet
+      size_t pendingSent = 0;
+      std::string tail;                // Text after the entries, cleared once queued
+      std::string cacheKey;            // Listing cache key, empty when not cached
+      std::string capture;             // Copy of the body while it fits in the cache
+      uint32_t generation = 0;
+    };
+#endif
+
+#if FSMANAGER_ASYNC && FSMANAGER_ENABLE_ARCHIVE
+    // Archive response the async server pulls piece by piece
+    struct ArchiveStream
+    {
+      explicit ArchiveStream(FSmanager &owner) : walker(owner) {}
+      std::string folder;              // Entry names are relative to it
+      TreeWalker walker;               // Stays open between pieces
+      File file;
+      size_t dataLeft = 0;             // File bytes of the current entry still to send
+      size_t zerosLeft = 0;            // Padding after the data, or the end-of-archive blocks
+      char header[512];
+      size_t headerLeft = 0;           // Bytes at the end of header still to send
+      bool ended = false;              // End-of-archive blocks queued
+      size_t entries = 0;
+      size_t skipped = 0;
+    };
+#endif
+
+    // Instrumented handlers, index into the statistics table
+    enum StatId
+    {
+      STAT_FILELIST, STAT_DELETE, STAT_DOWNLOAD, STAT_CHECKSPACE, STAT_UPLOAD,
+      STAT_CHUNKED, STAT_CHUNKED_CONTROL, STAT_CREATEFOLDER, STAT_DELETEFOLDER,
+      STAT_BATCH, STAT_ARCHIVE, STAT_SYSTEMFILE, STAT_USEDSPACE, STAT_COUNT
+    };
+
+    // Counters taken when an instrumented call starts
+    struct StatSnapshot
+    {
+      uint32_t start;
+      uint32_t heap;
+      uint32_t block;
+      uint64_t bytesIn;
+      uint64_t bytesOut;
+      uint32_t fsOpens;
+      uint32_t uploadMicros;      // Upload callbacks of the request, added when it completes
+    };
+
   public:
+    // Content type of a file extension, with the Cache-Control a system
+    // file of this type gets by default and whether a browser may show it
+    struct MimeType
+    {
+      const char* extension;      // Lower case, without the dot
+      const char* contentType;
+      const char* cacheControl;
+      bool        inlineDisposition;
+    };
+
+    // Counters of one instrumented handler, see getStats()
+    struct HandlerStats
+    {
+      const char* name;
+      uint32_t calls;
+      uint32_t minMicros;
+      uint32_t maxMicros;
+      uint64_t totalMicros;
+      uint64_t bytesIn;
+      uint64_t bytesOut;
+      uint32_t fsOpens;
+      uint32_t heapBefore;   // Free heap around the last call
+      uint32_t heapAfter;
+      uint32_t blockBefore;  // Largest free block around the last call
+      uint32_t blockAfter;
+    };
+
     FSmanager(WebServerClass &server);
     void begin(Stream* debugOutput = &Serial);
     void setSystemFilePath(const std::string &path);
     std::string getSystemFilePath() const;
-    void addSystemFile(const std::string &fileName, bool setServe = true);
+    void addSystemFile(const std::string &fileName, bool setServe = true, const std::string &cacheControl = "");
+    void addSystemFolder(const std::string &folder);
+    void addMimeType(const char* extension, const char* contentType, const char* cacheControl = "no-cache", bool inlineDisposition = true);
+    MimeType getMimeType(const char* path) const;
     std::string getCurrentFolder();
+    void resyncUsedSpace();
+    void invalidateListings();
+    void setSpaceResyncInterval(uint32_t intervalMs);
+    void setUploadBufferSize(size_t size);
+    size_t getStats(const HandlerStats* &stats) const;
+    void resetStats();
+    size_t drainLog(size_t maxBytes = FSMANAGER_LOG_DRAIN_BYTES);
+    uint32_t getDroppedLogLines() const;
 
   private:
-    WebServerClass *server;
-    std::string currentFolder;
-    std::string uploadFolder;  // Store folder path during upload
+    WebServerClass *webServer;    // Routes are registered here
+    RequestClass *server;         // Request being handled, the WebServer itself when synchronous
     std::string systemPath;    // New variable for system files path
     Stream* debugPort;
-    File uploadFile;
-    std::set<std::string> systemFiles;
-    bool lastUploadSuccess;
-    size_t trackedUsedSpace;  // Track used space during upload
+    std::vector<uint32_t> systemFileHashes;    // Sorted hashes of protected files
+    std::vector<uint32_t> systemPrefixHashes;  // Sorted hashes of protected folders ("/dir/")
+    std::vector<CustomMimeType> customMimeTypes;
+    size_t trackedUsedSpace;      // Used space, kept current by the handlers
+    size_t spaceBlockSize;        // Allocation unit used for trackedUsedSpace
+    size_t fsBlockSize;           // LittleFS block size
+    uint32_t spaceResyncInterval; // 0 = never recalculate from the filesystem
+    uint32_t lastSpaceResync;
+    ClientContext clientContexts[FSMANAGER_CLIENT_CONTEXTS];
+    uint32_t clientTick;          // LRU clock for clientContexts
+#if FSMANAGER_HAS_UPLOADS
+    UploadContext uploadContexts[FSMANAGER_UPLOAD_CONTEXTS];
+    UploadContext* uploadCtx;     // Context of the request being handled
+    uint64_t refusedConnection;   // Last upload turned away for lack of a context
+    size_t uploadBufferSize;
+#endif
+#if FSMANAGER_ENABLE_CHUNKED
+    UploadSession uploadSessions[FSMANAGER_UPLOAD_SESSIONS];
+#endif
+    char chunkBuffer[FSMANAGER_CHUNK_SIZE];  // Fixed buffer for streamed responses
+    size_t chunkLength;                      // Bytes pending in chunkBuffer
+    std::vector<ListEntry> listEntries;      // Reused by every listing
+    std::vector<char> listNames;             // '\0' separated entry names
+    std::string* chunkCapture;               // Copy of the streamed body, or nullptr
+#if FSMANAGER_ASYNC
+    std::string* chunkSink;                  // Takes sendChunk() text instead of the response, or nullptr
+#endif
+    ListCacheEntry listCache[FSMANAGER_LIST_CACHE_SIZE];
+    ListPager listPager;
+    uint32_t listGeneration;                 // Bumped by every change to the filesystem
+    uint32_t bootNonce;                      // Random per boot, part of every listing ETag
+    uint32_t listCacheTick;                  // LRU clock for listCache
+    uint8_t invalidationHolds;               // Nesting depth of holdInvalidation()
+    bool invalidationPending;
+#if FSMANAGER_STATS
+    HandlerStats handlerStats[STAT_COUNT];
+    uint64_t statBytesIn;                    // Running totals, sampled per call
+    uint64_t statBytesOut;
+    uint32_t statFsOpens;
+#endif
+#if FSMANAGER_LOG_BUFFER_SIZE > 0
+    char logBuffer[FSMANAGER_LOG_BUFFER_SIZE];
+    std::atomic<uint32_t> logHead;           // Free running, written by logLine()
+    std::atomic<uint32_t> logTail;           // Free running, written by drainLog()
+#ifdef ESP32
+    portMUX_TYPE logLock = portMUX_INITIALIZER_UNLOCKED;  // Between writers on both cores
+#endif
+#endif
+    std::atomic<uint32_t> logDropped;        // Lines that did not fit in logBuffer
+    void logLine(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void addRoute(const char* uri, MethodType method, const std::function<void()> &onRequest, const std::function<void()> &onUpload = nullptr, size_t maxBody = 0);
+#if FSMANAGER_ASYNC
+    void handleAsync(AsyncWebServerRequest* request, const std::function<void()> &handler);
+    static void receiveAsyncBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total, size_t maxBody);
+    void receiveAsyncUpload(AsyncWebServerRequest* request, const String &filename, size_t index, uint8_t* data, size_t len, bool final, const std::function<void()> &onUpload);
+#endif
+    void runHandler(StatId id, void (FSmanager::*handler)(), bool completes = true);
+    void statBegin(StatSnapshot &snap);
+    void statEnd(StatId id, const StatSnapshot &snap, bool completes);
+    void handleStats();
+    File openFile(const char* path, const char* mode);
+#ifndef ESP32
+    Dir openDirectory(const char* path);
+#endif
     void handleFileList();
+    void readDirectory(const std::string &folder);
+    void readDirectoryPage(const std::string &folder, size_t offset, size_t limit);
+    void closeListPager();
+    void countSubfolderFiles(const std::string &folder);
+    void sendListFiles(const std::string &folder);
+    void sendListFile(const std::string &folder, const ListEntry &entry, const char* name, bool &first);
+#if FSMANAGER_ASYNC
+    void streamList(const std::string &folder, const std::string &currentFolder, const char* tail, const std::string &cacheKey);
+    size_t readList(ListStream &list, uint8_t* buffer, size_t maxLen);
+#endif
+    bool readPageArgs(size_t &offset, size_t &limit);
+    void addListEntry(const char* name, bool isDir, size_t size, size_t originalSize);
+    size_t gzipOriginalSize(File &file);
+    size_t countFilesInDir(const std::string &dirPath, bool countDirs = false);
+    void makeListETag(const std::string &folder, const std::string &currentFolder, char* etag, size_t size);
+    void holdInvalidation();
+    void releaseInvalidation();
+    ClientContext &clientContext();
+    ListCacheEntry* findListCache(const std::string &folder);
+    ListCacheEntry* claimListCache(const std::string &folder);
+#if FSMANAGER_ENABLE_DELETE
     void handleDelete();
+#endif
+#if FSMANAGER_HAS_DELETE_FILE
+    int deleteFile(const FSPath &filename, const char* &message);
+#endif
+#if FSMANAGER_ENABLE_UPLOAD
     void handleUpload();
+    void handleUploadDone();
+    void handleCheckSpace();
+    void removePlainSibling();
+#endif
+#if FSMANAGER_HAS_UPLOADS
+    uint64_t connectionKey();
+    bool findUploadContext();
+#if FSMANAGER_STATS
+    uint32_t takeUploadMicros();
+#endif
+    bool claimUploadContext();
+    void releaseUploadContext();
+    void allocUploadBuffer();
+    void releaseUploadBuffer();
+    bool writeUploadData(const uint8_t* data, size_t len);
+    bool flushUploadBuffer();
+    void failUpload(int code, const char* reason);
+    void reportUploadPart(int code, size_t size, const char* message);
+    bool commitTempFile(const std::string &tempPath, const std::string &targetPath);
+    size_t roundToBlocks(size_t bytes);
+    bool hasSpaceFor(size_t bytes, size_t &availableSpace);
+#endif
+#if FSMANAGER_ENABLE_EXTRACT
+    void beginExtract();
+    bool extractTarData(const uint8_t* data, size_t len);
+    bool startTarEntry();
+    bool finishTarEntry();
+    void reportTarEntry(int code, const char* message);
+    void endExtract();
+#endif
+#if FSMANAGER_ENABLE_EXTRACT || FSMANAGER_HAS_FOLDER_OPS
+    bool makeParentFolders(const FSPath &path);
+#endif
+#if FSMANAGER_ENABLE_CHUNKED
+    void handleChunkedStart();
+    void handleChunkedData();
+    void handleChunkedChunk();
+    void handleChunkedStatus();
+    void handleChunkedCommit();
+    void handleChunkedCancel();
+    UploadSession* findUploadSession(const String &idArg);
+    void closeUploadSession(UploadSession &session, bool removeData);
+    size_t receivedChunks(const UploadSession &session);
+    void sendSessionInfo(const UploadSession &session);
+#endif
     void handleDownload();
+    size_t existingFileSize(const std::string &path);
+    File openForServing(const FSPath &path, bool &gzipped);
+    void sendFile(File &file, const char* contentType, const char* cacheControl, bool gzipped);
+    void sendFileBody(File &file, size_t length);
+    void sendFileRange(File &file, const char* contentType, const char* rangeHeader);
+    bool parseRange(const char* header, size_t fileSize, size_t &start, size_t &end);
+    void serveSystemFile(const FSPath &path, const std::string &cacheControl);
+#if FSMANAGER_ENABLE_FOLDERS
     void handleCreateFolder();
     void handleDeleteFolder();
+#endif
+#if FSMANAGER_HAS_FOLDER_OPS
+    int createFolder(const FSPath &folderName, const char* &message);
+    int deleteFolder(const FSPath &folderName, const char* &message);
+    int deleteFolderTree(const FSPath &folderName, const char* &message, size_t &removed, size_t &kept);
+#endif
+#if FSMANAGER_ENABLE_BATCH
+    int moveFile(const FSPath &from, const FSPath &to, const char* &message);
+    bool holdsSystemFiles(const FSPath &folder);
+    void handleBatch();
+#endif
+#if FSMANAGER_ENABLE_ARCHIVE
+    void handleArchive();
+    bool sendTarHeader(const std::string &name, bool isDir, size_t size, time_t mtime);
+#if FSMANAGER_ASYNC
+    size_t readArchive(ArchiveStream &archive, uint8_t* buffer, size_t maxLen);
+#endif
+#endif
     std::string formatSize(size_t bytes);
-    bool isSystemFile(const std::string &filename);
+    void beginChunkedResponse(int code, const char* contentType);
+    void sendChunk(const char* text);
+    void sendChunk(const char* text, size_t len);
+    void flushChunk();
+    void endChunkedResponse();
+    void sendListEntry(const char* name, bool isDir, size_t size, bool isReadOnly, bool &first, size_t originalSize = 0);
+    bool isSystemFile(const char* path);
+    bool isSystemFile(const char* folder, const char* name);
     size_t getTotalSpace();
     size_t getUsedSpace();
-    void handleCheckSpace();
-#ifdef FSMANAGER_DEBUG
-  bool doDebug = true;
-#else
-  bool doDebug = false;
-#endif
+    size_t calculateUsedSpace();
+    void walkTree(const std::string &dirPath, const WalkCallback &visit);
+    bool folderExists(const char* path);
+    void adjustUsedSpace(size_t removedBytes, size_t addedBytes);
 };
 
 #endif // FSMANAGER_H
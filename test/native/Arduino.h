@@ -0,0 +1,160 @@
+// Arduino core stand-in for the native (host) build, only what FSmanager
+// and the benchmarks use
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+
+// ESP8266 hardware random number register
+#define RANDOM_REG32 ((uint32_t)random())
+
+class String
+{
+  public:
+    String() {}
+    String(const char* text) : str(text ? text : "") {}
+    String(const String &other) = default;
+    String(char c) : str(1, c) {}
+    String(int value) : str(std::to_string(value)) {}
+    String(unsigned int value) : str(std::to_string(value)) {}
+    String(long value) : str(std::to_string(value)) {}
+    String(unsigned long value) : str(std::to_string(value)) {}
+    String &operator=(const String &other) = default;
+    String &operator=(const char* text) { str = text ? text : ""; return *this; }
+
+    const char* c_str() const { return str.c_str(); }
+    unsigned int length() const { return str.length(); }
+    bool isEmpty() const { return str.empty(); }
+    bool reserve(unsigned int size) { str.reserve(size); return true; }
+    char charAt(unsigned int index) const { return index < str.length() ? str[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    bool startsWith(const String &prefix) const { return str.compare(0, prefix.str.length(), prefix.str) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+      return str.length() >= suffix.str.length()
+          && str.compare(str.length() - suffix.str.length(), suffix.str.length(), suffix.str) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const { size_t at = str.find(c, from); return at == std::string::npos ? -1 : (int)at; }
+    int indexOf(const String &text, unsigned int from = 0) const { size_t at = str.find(text.str, from); return at == std::string::npos ? -1 : (int)at; }
+    int lastIndexOf(char c) const { size_t at = str.rfind(c); return at == std::string::npos ? -1 : (int)at; }
+    String substring(unsigned int from) const { return from < str.length() ? String(str.substr(from).c_str()) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+      if (from >= str.length() || to <= from) return String();
+      return String(str.substr(from, to - from).c_str());
+    }
+    long toInt() const { return strtol(str.c_str(), nullptr, 10); }
+    void toLowerCase() { for (char &c : str) if (c >= 'A' && c <= 'Z') c += 'a' - 'A'; }
+    void trim()
+    {
+      size_t first = str.find_first_not_of(" \t\r\n");
+      size_t last = str.find_last_not_of(" \t\r\n");
+      str = (first == std::string::npos) ? "" : str.substr(first, last - first + 1);
+    }
+    bool concat(const char* text, unsigned int len) { str.append(text, len); return true; }
+
+    String &operator+=(const String &other) { str += other.str; return *this; }
+    String &operator+=(const char* text) { str += text; return *this; }
+    String &operator+=(char c) { str += c; return *this; }
+    bool operator==(const String &other) const { return str == other.str; }
+    bool operator==(const char* text) const { return str == text; }
+    bool operator!=(const String &other) const { return str != other.str; }
+    bool operator!=(const char* text) const { return str != text; }
+    bool operator<(const String &other) const { return str < other.str; }
+
+    friend String operator+(const String &a, const String &b) { String s(a); s += b; return s; }
+    friend String operator+(const String &a, const char* b) { String s(a); s += b; return s; }
+    friend String operator+(const char* a, const String &b) { String s(a); s += b; return s; }
+
+  private:
+    std::string str;
+};
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+      size_t n = 0;
+      while (n < size && write(buffer[n])) n++;
+      return n;
+    }
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String &text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return print(String(value)); }
+    size_t print(unsigned int value) { return print(String(value)); }
+    size_t print(long value) { return print(String(value)); }
+    size_t print(unsigned long value) { return print(String(value)); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T &value) { size_t n = print(value); return n + println(); }
+    virtual void flush() {}
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    size_t readBytes(uint8_t* buffer, size_t length)
+    {
+      size_t n = 0;
+      int c;
+      while (n < length && (c = read()) >= 0) buffer[n++] = (uint8_t)c;
+      return n;
+    }
+    size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+};
+
+// Writes to stdout unless muted, the benchmarks mute it around timed code
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { if (!muted) fputc(c, stdout); return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { if (!muted) fwrite(buffer, 1, size, stdout); return size; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    int availableForWrite() { return 1024; }
+    bool muted = false;
+};
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+struct EspClass
+{
+  uint32_t getFlashChipRealSize() { return 64 * 1024 * 1024; }  // FSmanager takes a quarter for LittleFS
+  uint32_t getFreeHeap() { return 40000; }
+  uint32_t getMaxFreeBlockSize() { return 30000; }
+  uint32_t getMaxAllocHeap() { return 30000; }
+  void restart() { exit(0); }
+};
+extern EspClass ESP;
+
+// Native only: bytes held through operator new, and the most held at once
+// since the last nativeHeapResetPeak(). The benchmarks read these.
+size_t nativeHeapInUse();
+size_t nativeHeapPeak();
+void nativeHeapResetPeak();
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,171 @@
+// ESP8266WebServer stand-in, see ESP8266WebServer.h
+#include <ESP8266WebServer.h>
+#include <strings.h>
+
+void ESP8266WebServer::on(const String &uri, HTTPMethod method, THandlerFunction onRequest)
+{
+  routes.push_back({ uri, method, onRequest, nullptr });
+}
+
+void ESP8266WebServer::on(const String &uri, HTTPMethod method, THandlerFunction onRequest, THandlerFunction onUpload)
+{
+  routes.push_back({ uri, method, onRequest, onUpload });
+}
+
+String ESP8266WebServer::arg(const String &name)
+{
+  for (const auto &entry : args_)
+  {
+    if (entry.first == name) return entry.second;
+  }
+  return String();
+}
+
+bool ESP8266WebServer::hasArg(const String &name)
+{
+  for (const auto &entry : args_)
+  {
+    if (entry.first == name) return true;
+  }
+  return false;
+}
+
+String ESP8266WebServer::header(const String &name)
+{
+  for (const auto &entry : headers_)
+  {
+    if (strcasecmp(entry.first.c_str(), name.c_str()) == 0) return entry.second;
+  }
+  return String();
+}
+
+bool ESP8266WebServer::hasHeader(const String &name)
+{
+  for (const auto &entry : headers_)
+  {
+    if (strcasecmp(entry.first.c_str(), name.c_str()) == 0) return true;
+  }
+  return false;
+}
+
+void ESP8266WebServer::send(int code, const char* contentType, const String &content)
+{
+  answer.code = code;
+  answer.contentType = contentType ? contentType : "";
+  answer.headers.insert(answer.headers.end(), pendingHeaders.begin(), pendingHeaders.end());
+  pendingHeaders.clear();
+  sendContent(content.c_str(), content.length());
+}
+
+void ESP8266WebServer::sendHeader(const String &name, const String &value, bool first)
+{
+  if (first) pendingHeaders.insert(pendingHeaders.begin(), { name, value });
+  else       pendingHeaders.push_back({ name, value });
+}
+
+void ESP8266WebServer::sendContent(const char* content, size_t size)
+{
+  answer.bodyBytes += size;
+  if (keepBody) answer.body.append(content, size);
+}
+
+size_t ESP8266WebServer::streamFile(File &file, const String &contentType, HTTPMethod method)
+{
+  (void)method;
+  // As the cores do: a ".gz" name is sent gzip-encoded unless its type says
+  // it is a plain gzip file
+  if (String(file.name()).endsWith(".gz") && contentType != "application/x-gzip" && contentType != "application/octet-stream")
+  {
+    sendHeader("Content-Encoding", "gzip");
+  }
+  send(200, contentType.c_str(), "");
+  uint8_t buffer[1460];
+  size_t sent = 0;
+  size_t got;
+  while ((got = file.read(buffer, sizeof(buffer))) > 0)
+  {
+    sendContent((const char*)buffer, got);
+    sent += got;
+  }
+  return sent;
+}
+
+ESP8266WebServer::Route* ESP8266WebServer::findRoute(const char* uri, HTTPMethod method)
+{
+  for (Route &route : routes)
+  {
+    if (route.uri == uri && (route.method == method || route.method == HTTP_ANY)) return &route;
+  }
+  return nullptr;
+}
+
+void ESP8266WebServer::startRequest(HTTPMethod method, const char* uri, const char* query,
+                                    const std::vector<std::pair<String, String>> &headers)
+{
+  requestMethod = method;
+  requestUri = uri;
+  headers_ = headers;
+  pendingHeaders.clear();
+  args_.clear();
+  contentLength = 0;
+  answer = NativeResponse();
+  std::string pairs = query;
+  size_t start = 0;
+  while (start < pairs.size())
+  {
+    size_t end = pairs.find('&', start);
+    if (end == std::string::npos) end = pairs.size();
+    std::string pair = pairs.substr(start, end - start);
+    size_t equals = pair.find('=');
+    if (equals == std::string::npos) args_.push_back({ String(pair.c_str()), String() });
+    else args_.push_back({ String(pair.substr(0, equals).c_str()), String(pair.substr(equals + 1).c_str()) });
+    start = end + 1;
+  }
+  for (const auto &entry : headers_)
+  {
+    if (strcasecmp(entry.first.c_str(), "Content-Length") == 0) contentLength = entry.second.toInt();
+  }
+}
+
+const NativeResponse &ESP8266WebServer::request(HTTPMethod method, const char* uri, const char* query,
+                                                const std::vector<std::pair<String, String>> &headers)
+{
+  startRequest(method, uri, query, headers);
+  Route* route = findRoute(uri, method);
+  if (route != nullptr) route->onRequest();
+  else if (notFound) notFound();
+  return answer;
+}
+
+const NativeResponse &ESP8266WebServer::upload(const char* uri, const char* query, const char* field, const char* filename,
+                                               const uint8_t* data, size_t size, size_t partSize)
+{
+  String length(size + 200);
+  startRequest(HTTP_POST, uri, query, { { "Content-Length", length } });
+  Route* route = findRoute(uri, HTTP_POST);
+  if (route == nullptr || !route->onUpload) return request(HTTP_POST, uri, query);
+  if (partSize > HTTP_UPLOAD_BUFLEN) partSize = HTTP_UPLOAD_BUFLEN;
+
+  currentUpload.status = UPLOAD_FILE_START;
+  currentUpload.name = field;
+  currentUpload.filename = filename;
+  currentUpload.type = "application/octet-stream";
+  currentUpload.totalSize = 0;
+  currentUpload.currentSize = 0;
+  currentUpload.contentLength = size + 200;
+  route->onUpload();
+  for (size_t offset = 0; offset < size; offset += partSize)
+  {
+    size_t part = (size - offset < partSize) ? size - offset : partSize;
+    currentUpload.status = UPLOAD_FILE_WRITE;
+    memcpy(currentUpload.buf, data + offset, part);
+    currentUpload.currentSize = part;
+    currentUpload.totalSize += part;
+    route->onUpload();
+  }
+  currentUpload.status = UPLOAD_FILE_END;
+  currentUpload.currentSize = 0;
+  route->onUpload();
+  route->onRequest();
+  return answer;
+}
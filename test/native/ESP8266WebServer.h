@@ -0,0 +1,118 @@
+// ESP8266WebServer stand-in for the native (host) build. Handlers are
+// registered as on the device; a test runs a request with request() or
+// upload() and reads the answer from response().
+#ifndef NATIVE_ESP8266WEBSERVER_H
+#define NATIVE_ESP8266WEBSERVER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "NativeResponse.h"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+#define HTTP_UPLOAD_BUFLEN 2048
+#define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+
+struct HTTPUpload
+{
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  size_t contentLength;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class WiFiClient
+{
+  public:
+    uint32_t remoteIP() { return address; }
+    uint16_t remotePort() { return port; }
+    uint8_t connected() { return 1; }
+    uint32_t address = 0x0100007f;
+    uint16_t port = 50000;
+};
+
+class ESP8266WebServer
+{
+  public:
+    typedef std::function<void(void)> THandlerFunction;
+
+    explicit ESP8266WebServer(int port = 80) { (void)port; }
+    void begin() {}
+    void handleClient() {}
+    void on(const String &uri, HTTPMethod method, THandlerFunction onRequest);
+    void on(const String &uri, HTTPMethod method, THandlerFunction onRequest, THandlerFunction onUpload);
+    void onNotFound(THandlerFunction fn) { notFound = fn; }
+    void serveStatic(const char*, fs::FS&, const char*, const char* = nullptr) {}
+
+    // Request being handled
+    String uri() { return requestUri; }
+    HTTPMethod method() { return requestMethod; }
+    String arg(const String &name);
+    String arg(int index) { return args_[index].second; }
+    String argName(int index) { return args_[index].first; }
+    int args() { return args_.size(); }
+    bool hasArg(const String &name);
+    String header(const String &name);
+    bool hasHeader(const String &name);
+    int headers() { return headers_.size(); }
+    void collectHeaders(const char* headerKeys[], const size_t headerKeysCount) { (void)headerKeys; (void)headerKeysCount; }
+    size_t clientContentLength() { return contentLength; }
+    HTTPUpload &upload() { return currentUpload; }
+    WiFiClient &client() { return wifiClient; }
+
+    // Answer
+    void send(int code, const char* contentType, const String &content);
+    void send(int code, const String &contentType, const String &content) { send(code, contentType.c_str(), content); }
+    void send(int code, const char* contentType = nullptr, const char* content = nullptr) { send(code, contentType, String(content)); }
+    void sendHeader(const String &name, const String &value, bool first = false);
+    void setContentLength(size_t length) { (void)length; }
+    void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+    void sendContent(const char* content) { sendContent(content, strlen(content)); }
+    void sendContent(const char* content, size_t size);
+    size_t streamFile(File &file, const String &contentType, HTTPMethod method = HTTP_GET);
+
+    // Native only: run one request through the registered handlers.
+    // query holds "name=value" pairs joined with '&', values are not decoded.
+    const NativeResponse &request(HTTPMethod method, const char* uri, const char* query = "",
+                                  const std::vector<std::pair<String, String>> &headers = {});
+    // Multipart upload of data in parts of partSize bytes, fields are sent as args
+    const NativeResponse &upload(const char* uri, const char* query, const char* field, const char* filename,
+                                 const uint8_t* data, size_t size, size_t partSize);
+    const NativeResponse &response() const { return answer; }
+    bool keepBody = true;   // false only counts the body bytes
+
+  private:
+    struct Route
+    {
+      String uri;
+      HTTPMethod method;
+      THandlerFunction onRequest;
+      THandlerFunction onUpload;
+    };
+    Route* findRoute(const char* uri, HTTPMethod method);
+    void startRequest(HTTPMethod method, const char* uri, const char* query,
+                      const std::vector<std::pair<String, String>> &headers);
+
+    std::vector<Route> routes;
+    THandlerFunction notFound;
+    String requestUri;
+    HTTPMethod requestMethod = HTTP_GET;
+    std::vector<std::pair<String, String>> args_;
+    std::vector<std::pair<String, String>> headers_;
+    std::vector<std::pair<String, String>> pendingHeaders;
+    size_t contentLength = 0;
+    HTTPUpload currentUpload;
+    WiFiClient wifiClient;
+    NativeResponse answer;
+};
+
+#endif // NATIVE_ESP8266WEBSERVER_H
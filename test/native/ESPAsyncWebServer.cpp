@@ -0,0 +1,231 @@
+// ESPAsyncWebServer stand-in, see ESPAsyncWebServer.h
+#include <ESPAsyncWebServer.h>
+#include <strings.h>
+
+static const String emptyString;
+
+AsyncWebServerRequest::~AsyncWebServerRequest()
+{
+  delete response;
+  free(_tempObject);
+}
+
+bool AsyncWebServerRequest::hasArg(const char* name) const
+{
+  for (const auto &entry : args)
+  {
+    if (entry.first == name) return true;
+  }
+  return false;
+}
+
+const String &AsyncWebServerRequest::arg(const char* name) const
+{
+  for (const auto &entry : args)
+  {
+    if (entry.first == name) return entry.second;
+  }
+  return emptyString;
+}
+
+bool AsyncWebServerRequest::hasHeader(const char* name) const
+{
+  for (const auto &entry : headers)
+  {
+    if (strcasecmp(entry.first.c_str(), name) == 0) return true;
+  }
+  return false;
+}
+
+const String &AsyncWebServerRequest::header(const char* name) const
+{
+  for (const auto &entry : headers)
+  {
+    if (strcasecmp(entry.first.c_str(), name) == 0) return entry.second;
+  }
+  return emptyString;
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const char* contentType, const char* content)
+{
+  AsyncWebServerResponse* answer = new AsyncWebServerResponse();
+  answer->code = code;
+  answer->contentType = contentType ? contentType : "";
+  answer->content = content ? content : "";
+  return answer;
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(const char* contentType, size_t len, AwsResponseFiller callback)
+{
+  AsyncWebServerResponse* answer = new AsyncWebServerResponse();
+  answer->contentType = contentType;
+  answer->filler = callback;
+  answer->length = len;
+  return answer;
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginChunkedResponse(const char* contentType, AwsResponseFiller callback)
+{
+  AsyncWebServerResponse* answer = new AsyncWebServerResponse();
+  answer->contentType = contentType;
+  answer->filler = callback;
+  answer->chunked = true;
+  return answer;
+}
+
+AsyncResponseStream* AsyncWebServerRequest::beginResponseStream(const char* contentType, size_t bufferSize)
+{
+  (void)bufferSize;
+  AsyncResponseStream* answer = new AsyncResponseStream();
+  answer->contentType = contentType;
+  return answer;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* answer)
+{
+  // The first response wins, as on the device
+  if (response != nullptr)
+  {
+    delete answer;
+    return;
+  }
+  response = answer;
+}
+
+void AsyncWebServerRequest::send(int code, const char* contentType, const char* content)
+{
+  send(beginResponse(code, contentType, content));
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest)
+{
+  return on(uri, method, onRequest, nullptr, nullptr);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                            ArUploadHandlerFunction onUpload)
+{
+  return on(uri, method, onRequest, onUpload, nullptr);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                            ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody)
+{
+  routes.push_back({ String(uri), method, onRequest, onUpload, onBody });
+  return handler;
+}
+
+AsyncWebServer::Route* AsyncWebServer::findRoute(const char* uri, WebRequestMethodComposite method)
+{
+  for (Route &route : routes)
+  {
+    if (route.uri == uri && (route.method & method)) return &route;
+  }
+  return nullptr;
+}
+
+void AsyncWebServer::startRequest(AsyncWebServerRequest &request, WebRequestMethodComposite method, const char* uri,
+                                  const char* query, const std::vector<std::pair<String, String>> &headers)
+{
+  request.requestMethod = method;
+  request.requestUri = uri;
+  request.headers = headers;
+  answer = NativeResponse();
+  std::string pairs = query;
+  size_t start = 0;
+  while (start < pairs.size())
+  {
+    size_t end = pairs.find('&', start);
+    if (end == std::string::npos) end = pairs.size();
+    std::string pair = pairs.substr(start, end - start);
+    size_t equals = pair.find('=');
+    if (equals == std::string::npos) request.args.push_back({ String(pair.c_str()), String() });
+    else request.args.push_back({ String(pair.substr(0, equals).c_str()), String(pair.substr(equals + 1).c_str()) });
+    start = end + 1;
+  }
+}
+
+void AsyncWebServer::finishRequest(AsyncWebServerRequest &request)
+{
+  // The response is sent after the handler returned, a filler is called
+  // until it has nothing more (chunked) or the promised length is sent
+  AsyncWebServerResponse* sent = request.response;
+  if (sent == nullptr)
+  {
+    answer.code = 500;
+  }
+  else
+  {
+    answer.code = sent->code;
+    answer.contentType = sent->contentType;
+    answer.headers = sent->headers;
+    answer.chunked = sent->chunked;
+    if (sent->filler)
+    {
+      std::vector<uint8_t> buffer(sendSize);
+      size_t index = 0;
+      while (sent->chunked || index < sent->length)
+      {
+        size_t room = sent->chunked ? sendSize : std::min(sendSize, sent->length - index);
+        size_t got = sent->filler(buffer.data(), room, index);
+        if (got == 0) break;
+        answer.body.append((const char*)buffer.data(), got);
+        answer.pieces++;
+        index += got;
+      }
+    }
+    else
+    {
+      answer.body = sent->content;
+    }
+    answer.bodyBytes = answer.body.size();
+  }
+  if (request.disconnect) request.disconnect();
+}
+
+const NativeResponse &AsyncWebServer::request(WebRequestMethodComposite method, const char* uri, const char* query,
+                                              const std::vector<std::pair<String, String>> &headers, const std::string &body)
+{
+  AsyncWebServerRequest request;
+  startRequest(request, method, uri, query, headers);
+  request.bodyLength = body.size();
+  Route* route = findRoute(uri, method);
+  if (route != nullptr && route->onBody && !body.empty())
+  {
+    // In pieces of one TCP segment, as the body arrives on the device
+    for (size_t index = 0; index < body.size(); index += sendSize)
+    {
+      size_t part = std::min(sendSize, body.size() - index);
+      route->onBody(&request, (uint8_t*)body.data() + index, part, index, body.size());
+    }
+  }
+  if (route != nullptr) route->onRequest(&request);
+  else if (notFound) notFound(&request);
+  finishRequest(request);
+  return answer;
+}
+
+const NativeResponse &AsyncWebServer::upload(const char* uri, const char* query, const char* filename,
+                                             const uint8_t* data, size_t size, size_t partSize)
+{
+  AsyncWebServerRequest request;
+  startRequest(request, HTTP_POST, uri, query, {});
+  request.bodyLength = size + 200;
+  Route* route = findRoute(uri, HTTP_POST);
+  if (route != nullptr && route->onUpload)
+  {
+    std::vector<uint8_t> part;
+    size_t index = 0;
+    do
+    {
+      size_t len = std::min(partSize, size - index);
+      part.assign(data + index, data + index + len);
+      route->onUpload(&request, String(filename), index, part.data(), len, index + len >= size);
+      index += len;
+    } while (index < size);
+  }
+  if (route != nullptr) route->onRequest(&request);
+  else if (notFound) notFound(&request);
+  finishRequest(request);
+  return answer;
+}
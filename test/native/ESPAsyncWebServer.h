@@ -0,0 +1,153 @@
+// ESPAsyncWebServer stand-in for the native (host) build. Handlers are
+// registered as on the device; a test runs a request with request() or
+// upload(). The body callbacks get the request body in pieces, and the
+// response is pulled from its filler the way the server sends it.
+#ifndef NATIVE_ESPASYNCWEBSERVER_H
+#define NATIVE_ESPASYNCWEBSERVER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "NativeResponse.h"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef enum
+{
+  HTTP_GET     = 0b00000001,
+  HTTP_POST    = 0b00000010,
+  HTTP_DELETE  = 0b00000100,
+  HTTP_PUT     = 0b00001000,
+  HTTP_PATCH   = 0b00010000,
+  HTTP_HEAD    = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY     = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServerRequest;
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void(void)> ArDisconnectHandler;
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, const String &filename, size_t index, uint8_t* data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
+
+class AsyncClient
+{
+  public:
+    uint32_t remoteIP() { return address; }
+    uint16_t remotePort() { return port; }
+    uint32_t address = 0x0100007f;
+    uint16_t port = 50000;
+};
+
+class AsyncWebServerResponse
+{
+  public:
+    virtual ~AsyncWebServerResponse() {}
+    void setCode(int code) { this->code = code; }
+    void addHeader(const String &name, const String &value) { headers.push_back({ name, value }); }
+
+    int code = 200;
+    String contentType;
+    std::vector<std::pair<String, String>> headers;
+    std::string content;          // Fixed body, or what a stream collected
+    AwsResponseFiller filler;     // Body pulled piece by piece
+    size_t length = 0;            // Body length of a filler, unless chunked
+    bool chunked = false;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print
+{
+  public:
+    size_t write(uint8_t c) override { content += (char)c; return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { content.append((const char*)buffer, size); return size; }
+    using Print::write;
+};
+
+class AsyncWebServerRequest
+{
+  public:
+    ~AsyncWebServerRequest();
+
+    AsyncClient* client() { return &clientRecord; }
+    const String &url() const { return requestUri; }
+    WebRequestMethodComposite method() const { return requestMethod; }
+    size_t contentLength() const { return bodyLength; }
+    bool hasArg(const char* name) const;
+    const String &arg(const char* name) const;
+    bool hasHeader(const char* name) const;
+    const String &header(const char* name) const;
+
+    AsyncWebServerResponse* beginResponse(int code, const char* contentType = "", const char* content = "");
+    AsyncWebServerResponse* beginResponse(const char* contentType, size_t len, AwsResponseFiller callback);
+    AsyncWebServerResponse* beginChunkedResponse(const char* contentType, AwsResponseFiller callback);
+    AsyncResponseStream* beginResponseStream(const char* contentType, size_t bufferSize = 1460);
+    void send(AsyncWebServerResponse* response);
+    void send(int code, const char* contentType = "", const char* content = "");
+    void onDisconnect(ArDisconnectHandler fn) { disconnect = fn; }
+
+    void* _tempObject = nullptr;  // Freed with free() when the request ends, as on the device
+
+  private:
+    friend class AsyncWebServer;
+    AsyncClient clientRecord;
+    String requestUri;
+    WebRequestMethodComposite requestMethod = HTTP_GET;
+    size_t bodyLength = 0;
+    std::vector<std::pair<String, String>> args;
+    std::vector<std::pair<String, String>> headers;
+    AsyncWebServerResponse* response = nullptr;
+    ArDisconnectHandler disconnect;
+};
+
+class AsyncCallbackWebHandler
+{
+};
+
+class AsyncWebServer
+{
+  public:
+    explicit AsyncWebServer(uint16_t port) { (void)port; }
+    void begin() {}
+    AsyncCallbackWebHandler &on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler &on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                ArUploadHandlerFunction onUpload);
+    AsyncCallbackWebHandler &on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody);
+    void onNotFound(ArRequestHandlerFunction fn) { notFound = fn; }
+
+    // Native only: run one request through the registered handlers.
+    // query holds "name=value" pairs joined with '&', values are not decoded;
+    // body is handed to the body callback of the route.
+    const NativeResponse &request(WebRequestMethodComposite method, const char* uri, const char* query = "",
+                                  const std::vector<std::pair<String, String>> &headers = {},
+                                  const std::string &body = std::string());
+    // Upload of one file in parts of partSize bytes
+    const NativeResponse &upload(const char* uri, const char* query, const char* filename,
+                                 const uint8_t* data, size_t size, size_t partSize);
+    const NativeResponse &response() const { return answer; }
+    size_t sendSize = 1460;         // Room the filler gets per call, one TCP segment
+
+  private:
+    struct Route
+    {
+      String uri;
+      WebRequestMethodComposite method;
+      ArRequestHandlerFunction onRequest;
+      ArUploadHandlerFunction onUpload;
+      ArBodyHandlerFunction onBody;
+    };
+    Route* findRoute(const char* uri, WebRequestMethodComposite method);
+    void startRequest(AsyncWebServerRequest &request, WebRequestMethodComposite method, const char* uri, const char* query,
+                      const std::vector<std::pair<String, String>> &headers);
+    void finishRequest(AsyncWebServerRequest &request);
+
+    AsyncCallbackWebHandler handler;
+    std::vector<Route> routes;
+    ArRequestHandlerFunction notFound;
+    NativeResponse answer;
+};
+
+#endif // NATIVE_ESPASYNCWEBSERVER_H
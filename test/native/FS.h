@@ -0,0 +1,106 @@
+// ESP8266 FS stand-in for the native (host) build. Files live in a host
+// directory (see fs::FS::setRoot()) and behave like ESP8266 LittleFS:
+// opening a file for writing creates its folders and removing the last
+// entry of a folder removes the folder.
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FSInfo
+{
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+struct NativeFile;
+struct NativeDir;
+
+class File : public Stream
+{
+  public:
+    File() {}
+    explicit File(std::shared_ptr<NativeFile> impl) : impl(impl) {}
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    size_t read(uint8_t* buffer, size_t size);
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void close() { impl.reset(); }
+    operator bool() const { return impl != nullptr; }
+    const char* name() const;
+    const char* fullName() const;
+    bool isDirectory() const;
+    time_t getLastWrite();
+
+  private:
+    std::shared_ptr<NativeFile> impl;
+};
+
+class Dir
+{
+  public:
+    Dir() {}
+    explicit Dir(std::shared_ptr<NativeDir> impl) : impl(impl) {}
+    bool next();
+    String fileName();
+    size_t fileSize();
+    time_t fileTime();
+    bool isDirectory();
+    bool isFile() { return !isDirectory(); }
+    File openFile(const char* mode);
+    bool rewind();
+
+  private:
+    std::shared_ptr<NativeDir> impl;
+};
+
+namespace fs
+{
+class FS
+{
+  public:
+    bool begin() { return true; }
+    void end() {}
+    File open(const char* path, const char* mode = "r");
+    File open(const String &path, const char* mode = "r") { return open(path.c_str(), mode); }
+    bool exists(const char* path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char* path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to);
+    bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+    bool mkdir(const char* path);
+    bool rmdir(const char* path);
+    bool info(FSInfo &info);
+    Dir openDir(const char* path);
+    Dir openDir(const String &path) { return openDir(path.c_str()); }
+
+    // Native only: host directory that holds the filesystem, and its size
+    void setRoot(const char* hostPath, size_t totalBytes = 2 * 1024 * 1024);
+    std::string hostPath(const char* path) const;
+
+  private:
+    std::string root;
+    size_t total = 0;
+};
+} // namespace fs
+
+using fs::FS;
+
+#endif // NATIVE_FS_H
@@ -0,0 +1,9 @@
+// LittleFS stand-in for the native (host) build
+#ifndef NATIVE_LITTLEFS_H
+#define NATIVE_LITTLEFS_H
+
+#include <FS.h>
+
+extern fs::FS LittleFS;
+
+#endif // NATIVE_LITTLEFS_H
@@ -0,0 +1,22 @@
+// Answer to a request run through one of the native web server stand-ins
+#ifndef NATIVE_RESPONSE_H
+#define NATIVE_RESPONSE_H
+
+#include <Arduino.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct NativeResponse
+{
+  int code = 0;
+  String contentType;
+  std::vector<std::pair<String, String>> headers;
+  std::string body;
+  size_t bodyBytes = 0;
+  bool chunked = false;   // Sent by a chunked filler
+  size_t pieces = 0;      // Filler calls that returned data
+  String header(const char* name) const;
+};
+
+#endif // NATIVE_RESPONSE_H
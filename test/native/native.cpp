@@ -0,0 +1,423 @@
+// Implementation of the native (host) stand-ins
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include "NativeResponse.h"
+
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <stdarg.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+fs::FS LittleFS;
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield()
+{
+}
+
+// Every block from operator new carries its size in front of it, so the
+// heap that strings, vectors and buffers take can be counted
+static size_t heapInUse = 0;
+static size_t heapPeak = 0;
+static constexpr size_t HEAP_HEADER = alignof(std::max_align_t);
+
+void* operator new(size_t size)
+{
+  uint8_t* block = (uint8_t*)malloc(size + HEAP_HEADER);
+  if (block == nullptr) throw std::bad_alloc();
+  *(size_t*)block = size;
+  heapInUse += size;
+  if (heapInUse > heapPeak) heapPeak = heapInUse;
+  return block + HEAP_HEADER;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* data) noexcept
+{
+  if (data == nullptr) return;
+  uint8_t* block = (uint8_t*)data - HEAP_HEADER;
+  heapInUse -= *(size_t*)block;
+  free(block);
+}
+
+void operator delete[](void* data) noexcept
+{
+  operator delete(data);
+}
+
+void operator delete(void* data, size_t size) noexcept
+{
+  (void)size;
+  operator delete(data);
+}
+
+void operator delete[](void* data, size_t size) noexcept
+{
+  (void)size;
+  operator delete(data);
+}
+
+size_t nativeHeapInUse()
+{
+  return heapInUse;
+}
+
+size_t nativeHeapPeak()
+{
+  return heapPeak;
+}
+
+void nativeHeapResetPeak()
+{
+  heapPeak = heapInUse;
+}
+
+size_t Print::printf(const char* format, ...)
+{
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len >= sizeof(line)) len = sizeof(line) - 1;
+  return write((const uint8_t*)line, len);
+}
+
+
+//=====================================================================
+// Files
+//=====================================================================
+
+struct NativeFile
+{
+  FILE* fp = nullptr;
+  std::string path;     // Path on the device
+  std::string name;     // Last component of path
+  std::string hostPath;
+  bool isDir = false;
+  ~NativeFile() { if (fp != nullptr) fclose(fp); }
+};
+
+struct NativeDir
+{
+  DIR* dir = nullptr;
+  std::string path;
+  std::string hostPath;
+  std::string entryName;
+  struct stat entry;
+  ~NativeDir() { if (dir != nullptr) closedir(dir); }
+};
+
+static std::string baseName(const std::string &path)
+{
+  size_t slash = path.find_last_of('/');
+  return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size)
+{
+  if (!impl || impl->fp == nullptr) return 0;
+  return fwrite(buffer, 1, size, impl->fp);
+}
+
+int File::available()
+{
+  if (!impl || impl->fp == nullptr) return 0;
+  return (int)(size() - position());
+}
+
+int File::read()
+{
+  uint8_t c;
+  return (read(&c, 1) == 1) ? c : -1;
+}
+
+int File::peek()
+{
+  if (!impl || impl->fp == nullptr) return -1;
+  int c = fgetc(impl->fp);
+  if (c != EOF) ungetc(c, impl->fp);
+  return (c == EOF) ? -1 : c;
+}
+
+void File::flush()
+{
+  if (impl && impl->fp != nullptr) fflush(impl->fp);
+}
+
+size_t File::read(uint8_t* buffer, size_t size)
+{
+  if (!impl || impl->fp == nullptr) return 0;
+  return fread(buffer, 1, size, impl->fp);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+  if (!impl || impl->fp == nullptr) return false;
+  int whence = (mode == SeekSet) ? SEEK_SET : (mode == SeekCur) ? SEEK_CUR : SEEK_END;
+  return fseek(impl->fp, pos, whence) == 0;
+}
+
+size_t File::position() const
+{
+  if (!impl || impl->fp == nullptr) return 0;
+  return ftell(impl->fp);
+}
+
+size_t File::size() const
+{
+  if (!impl) return 0;
+  if (impl->fp != nullptr) fflush(impl->fp);
+  struct stat st;
+  return (stat(impl->hostPath.c_str(), &st) == 0 && !impl->isDir) ? st.st_size : 0;
+}
+
+const char* File::name() const
+{
+  return impl ? impl->name.c_str() : "";
+}
+
+const char* File::fullName() const
+{
+  return impl ? impl->path.c_str() : "";
+}
+
+bool File::isDirectory() const
+{
+  return impl && impl->isDir;
+}
+
+time_t File::getLastWrite()
+{
+  struct stat st;
+  return (impl && stat(impl->hostPath.c_str(), &st) == 0) ? st.st_mtime : 0;
+}
+
+bool Dir::next()
+{
+  if (!impl || impl->dir == nullptr) return false;
+  struct dirent* entry;
+  while ((entry = readdir(impl->dir)) != nullptr)
+  {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    impl->entryName = entry->d_name;
+    std::string host = impl->hostPath + "/" + impl->entryName;
+    if (stat(host.c_str(), &impl->entry) != 0) continue;
+    return true;
+  }
+  return false;
+}
+
+String Dir::fileName()
+{
+  return impl ? String(impl->entryName.c_str()) : String();
+}
+
+size_t Dir::fileSize()
+{
+  return (impl && !S_ISDIR(impl->entry.st_mode)) ? impl->entry.st_size : 0;
+}
+
+time_t Dir::fileTime()
+{
+  return impl ? impl->entry.st_mtime : 0;
+}
+
+bool Dir::isDirectory()
+{
+  return impl && S_ISDIR(impl->entry.st_mode);
+}
+
+File Dir::openFile(const char* mode)
+{
+  if (!impl) return File();
+  std::string path = impl->path;
+  if (path.empty() || path.back() != '/') path += "/";
+  return LittleFS.open((path + impl->entryName).c_str(), mode);
+}
+
+bool Dir::rewind()
+{
+  if (!impl || impl->dir == nullptr) return false;
+  rewinddir(impl->dir);
+  return true;
+}
+
+
+//=====================================================================
+// Filesystem
+//=====================================================================
+
+namespace fs
+{
+
+void FS::setRoot(const char* hostPath, size_t totalBytes)
+{
+  root = hostPath;
+  total = totalBytes;
+  ::mkdir(root.c_str(), 0755);
+}
+
+std::string FS::hostPath(const char* path) const
+{
+  std::string host = root;
+  if (path[0] != '/') host += "/";
+  host += path;
+  while (host.size() > root.size() + 1 && host.back() == '/') host.pop_back();
+  return host;
+}
+
+static void makeFolders(const std::string &root, const std::string &hostPath)
+{
+  // Every folder between root and the file in hostPath
+  for (size_t slash = hostPath.find('/', root.size() + 1); slash != std::string::npos; slash = hostPath.find('/', slash + 1))
+  {
+    ::mkdir(hostPath.substr(0, slash).c_str(), 0755);
+  }
+}
+
+static void removeEmptyFolders(const std::string &root, std::string hostPath)
+{
+  // ESP8266 LittleFS drops the folders a removal leaves empty
+  for (size_t slash = hostPath.find_last_of('/'); slash != std::string::npos && slash > root.size(); slash = hostPath.find_last_of('/'))
+  {
+    hostPath.resize(slash);
+    if (::rmdir(hostPath.c_str()) != 0) break;
+  }
+}
+
+File FS::open(const char* path, const char* mode)
+{
+  std::shared_ptr<NativeFile> file = std::make_shared<NativeFile>();
+  file->path = path;
+  file->hostPath = hostPath(path);
+  file->name = baseName(file->hostPath);
+
+  struct stat st;
+  if (stat(file->hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+  {
+    if (mode[0] != 'r') return File();
+    file->isDir = true;
+    return File(file);
+  }
+  if (mode[0] != 'r') makeFolders(root, file->hostPath);
+  std::string hostMode = mode;
+  if (hostMode.find('b') == std::string::npos) hostMode += "b";
+  file->fp = fopen(file->hostPath.c_str(), hostMode.c_str());
+  if (file->fp == nullptr) return File();
+  return File(file);
+}
+
+bool FS::exists(const char* path)
+{
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path)
+{
+  std::string host = hostPath(path);
+  if (::remove(host.c_str()) != 0) return false;
+  removeEmptyFolders(root, host);
+  return true;
+}
+
+bool FS::rename(const char* from, const char* to)
+{
+  std::string hostFrom = hostPath(from);
+  std::string hostTo = hostPath(to);
+  makeFolders(root, hostTo);
+  if (::rename(hostFrom.c_str(), hostTo.c_str()) != 0) return false;
+  removeEmptyFolders(root, hostFrom);
+  return true;
+}
+
+bool FS::mkdir(const char* path)
+{
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool FS::rmdir(const char* path)
+{
+  return remove(path);
+}
+
+static size_t usedBlocks(const std::string &hostPath, size_t blockSize)
+{
+  size_t blocks = 0;
+  DIR* dir = opendir(hostPath.c_str());
+  if (dir == nullptr) return 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr)
+  {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    std::string path = hostPath + "/" + entry->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) blocks += 1 + usedBlocks(path, blockSize);
+    else blocks += (st.st_size + blockSize - 1) / blockSize;
+  }
+  closedir(dir);
+  return blocks;
+}
+
+bool FS::info(FSInfo &info)
+{
+  info.blockSize     = 4096;
+  info.pageSize      = 256;
+  info.maxOpenFiles  = 5;
+  info.maxPathLength = 32;
+  info.totalBytes    = total;
+  info.usedBytes     = (2 + usedBlocks(root, info.blockSize)) * info.blockSize;
+  return true;
+}
+
+Dir FS::openDir(const char* path)
+{
+  std::shared_ptr<NativeDir> dir = std::make_shared<NativeDir>();
+  dir->path = path;
+  dir->hostPath = hostPath(path);
+  dir->dir = opendir(dir->hostPath.c_str());
+  return Dir(dir);
+}
+
+} // namespace fs
+
+
+String NativeResponse::header(const char* name) const
+{
+  for (const auto &entry : headers)
+  {
+    if (strcasecmp(entry.first.c_str(), name) == 0) return entry.second;
+  }
+  return String();
+}
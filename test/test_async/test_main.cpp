@@ -0,0 +1,248 @@
+// Host tests of the async backend (FSMANAGER_ASYNC): pio test -e native_async
+//
+// FSmanager runs against the ESPAsyncWebServer stand-in in test/native,
+// which hands request bodies to the body callback and pulls responses
+// from their filler in pieces, the way the server on the device does.
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "FSmanager.h"
+
+static AsyncWebServer server(80);
+static FSmanager fsManager(server);
+
+
+static void writeFile(const char* path, const char* text)
+{
+  File file = LittleFS.open(path, "w");
+  file.print(text);
+  file.close();
+
+} // writeFile()
+
+
+static bool contains(const NativeResponse &answer, const char* text)
+{
+  return answer.body.find(text) != std::string::npos;
+
+} // contains()
+
+
+void setUp()
+{
+}
+
+
+void tearDown()
+{
+}
+
+
+static void test_batch()
+{
+  writeFile("/batch/one.txt", "one");
+  writeFile("/batch/two.txt", "two");
+  std::string body = "[{\"op\":\"mkdir\",\"path\":\"/batch/sub/\"},"
+                     " {\"op\":\"move\",\"from\":\"/batch/one.txt\",\"to\":\"/batch/sub/one.txt\"},"
+                     " {\"op\":\"delete\",\"path\":\"/batch/two.txt\"}]";
+  const NativeResponse &answer = server.request(HTTP_POST, "/fsm/batch", "", { { "Content-Type", "application/json" } }, body);
+  TEST_ASSERT_EQUAL_INT(200, answer.code);
+  TEST_ASSERT_TRUE_MESSAGE(contains(answer, "\"succeeded\":3,\"failed\":0"), answer.body.c_str());
+  TEST_ASSERT_TRUE(LittleFS.exists("/batch/sub/one.txt"));
+  TEST_ASSERT_FALSE(LittleFS.exists("/batch/one.txt"));
+  TEST_ASSERT_FALSE(LittleFS.exists("/batch/two.txt"));
+
+} // test_batch()
+
+
+static void test_batch_body_limit()
+{
+  // Padding after the array is still part of the body
+  std::string body = "[{\"op\":\"delete\",\"path\":\"/batch/sub/one.txt\"}]";
+  body.append(FSMANAGER_BATCH_MAX_BODY, ' ');
+  const NativeResponse &answer = server.request(HTTP_POST, "/fsm/batch", "", { { "Content-Type", "application/json" } }, body);
+  TEST_ASSERT_EQUAL_INT(413, answer.code);
+  TEST_ASSERT_TRUE(LittleFS.exists("/batch/sub/one.txt"));
+
+  const NativeResponse &empty = server.request(HTTP_POST, "/fsm/batch", "");
+  TEST_ASSERT_EQUAL_INT(400, empty.code);
+
+} // test_batch_body_limit()
+
+
+static void test_filelist()
+{
+  // The JSON is pulled from a chunked filler in pieces, nothing is
+  // assembled in a response stream
+  char path[48];
+  for (int i = 0; i < 200; i++)
+  {
+    snprintf(path, sizeof(path), "/many/file%03d.txt", i);
+    writeFile(path, "entry");
+  }
+  server.sendSize = 256;
+  const NativeResponse &first = server.request(HTTP_GET, "/fsm/filelist", "folder=/many/");
+  TEST_ASSERT_EQUAL_INT(200, first.code);
+  TEST_ASSERT_TRUE(first.chunked);
+  TEST_ASSERT_TRUE(first.pieces > 10);
+  TEST_ASSERT_TRUE(contains(first, "\"name\":\"file000.txt\""));
+  TEST_ASSERT_TRUE(contains(first, "\"name\":\"file199.txt\""));
+  TEST_ASSERT_EQUAL_INT('}', first.body.back());
+  std::string body = first.body;
+  String etag = first.header("ETag");
+
+  const NativeResponse &again = server.request(HTTP_GET, "/fsm/filelist", "folder=/many/", { { "If-None-Match", etag } });
+  TEST_ASSERT_EQUAL_INT(304, again.code);
+
+  // A page small enough for the cache is answered from it the second time
+  const NativeResponse &page = server.request(HTTP_GET, "/fsm/filelist", "folder=/many/&limit=10");
+  TEST_ASSERT_EQUAL_INT(200, page.code);
+  TEST_ASSERT_TRUE(page.chunked);
+  TEST_ASSERT_TRUE(contains(page, "\"total\":200"));
+  std::string pageBody = page.body;
+  const NativeResponse &cached = server.request(HTTP_GET, "/fsm/filelist", "folder=/many/&limit=10");
+  TEST_ASSERT_EQUAL_INT(200, cached.code);
+  TEST_ASSERT_FALSE(cached.chunked);
+  TEST_ASSERT_TRUE(cached.body == pageBody);
+
+  // The whole listing is the same whichever piece size the server takes
+  server.sendSize = 1460;
+  fsManager.invalidateListings();
+  const NativeResponse &large = server.request(HTTP_GET, "/fsm/filelist", "folder=/many/");
+  TEST_ASSERT_TRUE(large.body == body);
+
+} // test_filelist()
+
+
+static void test_delete_tree()
+{
+  // A large tree takes several requests, each removes a bounded part
+  char path[48];
+  for (int i = 0; i < 150; i++)
+  {
+    snprintf(path, sizeof(path), "/tree/sub%d/file%03d.txt", i % 3, i);
+    writeFile(path, "entry");
+  }
+  int requests = 0;
+  int code = 202;
+  while (code == 202 && requests < 10)
+  {
+    const NativeResponse &answer = server.request(HTTP_POST, "/fsm/deleteFolder", "folder=/tree/&recursive=1");
+    code = answer.code;
+    requests++;
+  }
+  TEST_ASSERT_EQUAL_INT(200, code);
+  TEST_ASSERT_TRUE(requests >= 3);
+  TEST_ASSERT_FALSE(LittleFS.exists("/tree"));
+
+} // test_delete_tree()
+
+
+static void test_upload()
+{
+  std::string data(10000, 'x');
+  const NativeResponse &answer = server.upload("/fsm/upload", "folder=/up/", "data.txt",
+                                               (const uint8_t*)data.data(), data.size(), 1460);
+  TEST_ASSERT_EQUAL_INT(200, answer.code);
+  File file = LittleFS.open("/up/data.txt", "r");
+  TEST_ASSERT_EQUAL_UINT32(data.size(), file.size());
+  file.close();
+
+} // test_upload()
+
+
+static void test_upload_gzip()
+{
+  // The bundled web pages mark compressed parts with ?compressed=gzip; the
+  // part replaces the plain file and is stored as "<name>.gz"
+  writeFile("/up/app.js", "plain");
+  static const uint8_t body[] = { 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+                                  0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+  const NativeResponse &answer = server.upload("/fsm/upload", "folder=/up/&compressed=gzip", "app.js",
+                                               body, sizeof(body), 1460);
+  TEST_ASSERT_EQUAL_INT(200, answer.code);
+  TEST_ASSERT_TRUE(LittleFS.exists("/up/app.js.gz"));
+  TEST_ASSERT_FALSE(LittleFS.exists("/up/app.js"));
+  File file = LittleFS.open("/up/app.js.gz", "r");
+  TEST_ASSERT_EQUAL_UINT32(sizeof(body), file.size());
+  file.close();
+
+} // test_upload_gzip()
+
+
+static void tarHeader(uint8_t* header, const char* name, char type, size_t size)
+{
+  memset(header, 0, 512);
+  strcpy((char*)header, name);
+  strcpy((char*)header + 100, "0000644");
+  snprintf((char*)header + 124, 12, "%011o", (unsigned)size);
+  strcpy((char*)header + 136, "00000000000");
+  header[156] = type;
+  memcpy(header + 257, "ustar", 6);
+  memset(header + 148, ' ', 8);
+  unsigned sum = 0;
+  for (int i = 0; i < 512; i++) sum += header[i];
+  snprintf((char*)header + 148, 8, "%06o", sum);
+
+} // tarHeader()
+
+
+static void test_extract_empty_folder()
+{
+  // A folder entry with nothing in it is kept, as /fsm/createFolder does
+  std::vector<uint8_t> tar(512 * 4, 0);
+  tarHeader(tar.data(), "empty/", '5', 0);
+  tarHeader(tar.data() + 512, "full/one.txt", '0', 3);
+  memcpy(tar.data() + 1024, "one", 3);
+  const NativeResponse &answer = server.upload("/fsm/upload", "folder=/unpack/&extract=tar", "folders.tar",
+                                               tar.data(), tar.size(), 1460);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(200, answer.code, answer.body.c_str());
+  TEST_ASSERT_TRUE_MESSAGE(contains(answer, "\"extracted\":2"), answer.body.c_str());
+
+  const NativeResponse &listing = server.request(HTTP_GET, "/fsm/filelist", "folder=/unpack/");
+  TEST_ASSERT_TRUE_MESSAGE(contains(listing, "\"name\":\"empty\""), listing.body.c_str());
+  TEST_ASSERT_TRUE_MESSAGE(contains(listing, "\"name\":\"full\""), listing.body.c_str());
+
+} // test_extract_empty_folder()
+
+
+static void test_download()
+{
+  std::string data(5000, 'y');
+  writeFile("/down.txt", data.c_str());
+  const NativeResponse &answer = server.request(HTTP_GET, "/fsm/download", "file=/down.txt");
+  TEST_ASSERT_EQUAL_INT(200, answer.code);
+  TEST_ASSERT_EQUAL_UINT32(data.size(), answer.bodyBytes);
+  TEST_ASSERT_TRUE(answer.body == data);
+
+} // test_download()
+
+
+int main()
+{
+  char root[] = "/tmp/fsmanager-async-XXXXXX";
+  if (mkdtemp(root) == nullptr) return 1;
+  LittleFS.setRoot(root, 16 * 1024 * 1024);
+
+  Serial.muted = true;
+  fsManager.begin(&Serial);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_filelist);
+  RUN_TEST(test_batch);
+  RUN_TEST(test_batch_body_limit);
+  RUN_TEST(test_delete_tree);
+  RUN_TEST(test_upload);
+  RUN_TEST(test_upload_gzip);
+  RUN_TEST(test_extract_empty_folder);
+  RUN_TEST(test_download);
+  int failures = UNITY_END();
+
+  std::string cleanup = std::string("rm -rf ") + root;
+  if (system(cleanup.c_str()) != 0) printf("Could not remove %s\n", root);
+  return failures;
+
+} // main()
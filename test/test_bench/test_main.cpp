@@ -0,0 +1,350 @@
+// Host benchmarks of the hot paths: pio test -e native
+//
+// FSmanager runs against the stand-ins in test/native, its filesystem is a
+// temporary host folder. Every benchmark prints its result and fails when
+// it is over its limit. The limits are far above what a workstation needs,
+// they catch complexity regressions (a listing that turns quadratic, an
+// upload that writes byte by byte) rather than small slowdowns, and can be
+// set with -D in build_flags for a slow CI runner.
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "FSmanager.h"
+
+#ifndef BENCH_MAX_LIST_US_PER_ENTRY       // /fsm/filelist, uncached
+  #define BENCH_MAX_LIST_US_PER_ENTRY 100
+#endif
+#ifndef BENCH_MAX_LIST_GROWTH             // 1000 entries against 100 entries
+  #define BENCH_MAX_LIST_GROWTH 25
+#endif
+#ifndef BENCH_MAX_LIST_HEAP_PER_ENTRY     // /fsm/filelist, peak heap above the idle heap
+  #define BENCH_MAX_LIST_HEAP_PER_ENTRY 32
+#endif
+#ifndef BENCH_MAX_LIST_HEAP_BASE
+  #define BENCH_MAX_LIST_HEAP_BASE 8192
+#endif
+#ifndef BENCH_MIN_UPLOAD_KBPS             // /fsm/upload, every chunk size
+  #define BENCH_MIN_UPLOAD_KBPS 2000
+#endif
+#ifndef BENCH_MIN_DOWNLOAD_KBPS           // /fsm/download
+  #define BENCH_MIN_DOWNLOAD_KBPS 5000
+#endif
+#ifndef BENCH_MAX_USED_SPACE_US_PER_ENTRY // resyncUsedSpace() walk
+  #define BENCH_MAX_USED_SPACE_US_PER_ENTRY 100
+#endif
+
+static const int    LIST_SIZES[]   = { 10, 100, 1000 };
+static const size_t CHUNK_SIZES[]  = { 256, 512, 1024, 2048 };
+static const size_t TRANSFER_BYTES = 512 * 1024;
+static const int    REPEATS        = 20;
+
+static ESP8266WebServer server(80);
+static FSmanager fsManager(server);
+static std::vector<uint8_t> payload;
+static uint32_t listMicros[3];
+static size_t listHeap[3];
+
+
+static void makeFiles(const char* folder, int count)
+{
+  char path[64];
+  for (int i = 0; i < count; i++)
+  {
+    snprintf(path, sizeof(path), "%sfile%04d.txt", folder, i);
+    File file = LittleFS.open(path, "w");
+    file.printf("entry %d\n", i);
+    file.close();
+  }
+
+} // makeFiles()
+
+
+static uint32_t kbPerSecond(size_t bytes, uint32_t micros)
+{
+  return (micros == 0) ? UINT32_MAX : (uint32_t)((uint64_t)bytes * 1000000 / 1024 / micros);
+
+} // kbPerSecond()
+
+
+void setUp()
+{
+}
+
+
+void tearDown()
+{
+}
+
+
+static void test_filelist()
+{
+  char folder[32];
+  char query[48];
+  for (int n = 0; n < 3; n++)
+  {
+    snprintf(folder, sizeof(folder), "/list%d/", LIST_SIZES[n]);
+    snprintf(query, sizeof(query), "folder=%s", folder);
+
+    // Uncached: the folder is enumerated every time
+    uint32_t total = 0;
+    for (int r = 0; r < REPEATS; r++)
+    {
+      fsManager.invalidateListings();
+      uint32_t start = micros();
+      const NativeResponse &answer = server.request(HTTP_GET, "/fsm/filelist", query);
+      total += micros() - start;
+      TEST_ASSERT_EQUAL_INT(200, answer.code);
+    }
+    listMicros[n] = total / REPEATS;
+
+    // Peak heap of one uncached listing, the response body is not kept so
+    // only what FSmanager itself holds is counted
+    fsManager.invalidateListings();
+    server.keepBody = false;
+    server.request(HTTP_GET, "/fsm/filelist", "folder=/");
+    size_t idle = nativeHeapInUse();
+    nativeHeapResetPeak();
+    TEST_ASSERT_EQUAL_INT(200, server.request(HTTP_GET, "/fsm/filelist", query).code);
+    listHeap[n] = nativeHeapPeak() - idle;
+    server.keepBody = true;
+
+    // Unchanged folder: answered from the cache, and with 304 on revalidation
+    uint32_t start = micros();
+    const NativeResponse &cached = server.request(HTTP_GET, "/fsm/filelist", query);
+    uint32_t cachedMicros = micros() - start;
+    String etag = cached.header("ETag");
+    start = micros();
+    const NativeResponse &revalidated = server.request(HTTP_GET, "/fsm/filelist", query, { { "If-None-Match", etag } });
+    uint32_t revalidateMicros = micros() - start;
+    TEST_ASSERT_EQUAL_INT(304, revalidated.code);
+
+    printf("filelist %5d entries: %7u us uncached (%.2f us/entry), %5u us cached, %5u us 304, peak heap %6u bytes\n",
+           LIST_SIZES[n], (unsigned)listMicros[n], (double)listMicros[n] / LIST_SIZES[n],
+           (unsigned)cachedMicros, (unsigned)revalidateMicros, (unsigned)listHeap[n]);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(BENCH_MAX_LIST_US_PER_ENTRY * (uint32_t)LIST_SIZES[n] + 1000, listMicros[n]);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(BENCH_MAX_LIST_HEAP_PER_ENTRY * (uint32_t)LIST_SIZES[n] + BENCH_MAX_LIST_HEAP_BASE, listHeap[n]);
+  }
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(BENCH_MAX_LIST_GROWTH * (listMicros[1] + 100), listMicros[2]);
+
+} // test_filelist()
+
+
+static void test_filelist_pages()
+{
+  // Follows the cursors through /list1000/ in pages of 100, as the web pages do
+  size_t entries = 0;
+  int pages = 0;
+  String query = "folder=/list1000/&limit=100";
+  const FSmanager::HandlerStats* stats = nullptr;
+  size_t handlers = fsManager.getStats(stats);
+  const FSmanager::HandlerStats* listStats = nullptr;
+  for (size_t i = 0; i < handlers; i++)
+  {
+    if (strcmp(stats[i].name, "filelist") == 0) listStats = &stats[i];
+  }
+  TEST_ASSERT_TRUE(listStats != nullptr);
+  fsManager.invalidateListings();
+  uint32_t start = micros();
+  while (true)
+  {
+    // Only the first page opens the folder (to read and to count), the
+    // others continue with the open directory
+    uint32_t opens = listStats->fsOpens;
+    const NativeResponse &page = server.request(HTTP_GET, "/fsm/filelist", query.c_str());
+    TEST_ASSERT_EQUAL_INT(200, page.code);
+    TEST_ASSERT_EQUAL_UINT32((pages == 0) ? 2 : 0, listStats->fsOpens - opens);
+    TEST_ASSERT_TRUE(page.body.find("\"total\":1000") != std::string::npos);
+    for (size_t at = page.body.find("{\"name\""); at != std::string::npos; at = page.body.find("{\"name\"", at + 1)) entries++;
+    pages++;
+    size_t cursor = page.body.find("\"nextCursor\":\"");
+    if (cursor == std::string::npos) break;
+    cursor += 14;
+    query = "folder=/list1000/&limit=100&cursor=";
+    query += page.body.substr(cursor, page.body.find('"', cursor) - cursor).c_str();
+  }
+  uint32_t elapsed = micros() - start;
+  TEST_ASSERT_EQUAL_UINT32(1000, entries);
+  TEST_ASSERT_EQUAL_INT(10, pages);
+
+  // An unchanged page is revalidated like a whole listing
+  const NativeResponse &first = server.request(HTTP_GET, "/fsm/filelist", "folder=/list1000/&limit=100");
+  String etag = first.header("ETag");
+  TEST_ASSERT_TRUE(etag.length() > 0);
+  TEST_ASSERT_EQUAL_INT(304, server.request(HTTP_GET, "/fsm/filelist", "folder=/list1000/&limit=100",
+                                            { { "If-None-Match", etag } }).code);
+  TEST_ASSERT_EQUAL_INT(200, server.request(HTTP_GET, "/fsm/filelist", "folder=/list1000/&limit=100&offset=100",
+                                            { { "If-None-Match", etag } }).code);
+
+  printf("filelist  1000 entries in %d pages: %7u us\n", pages, (unsigned)elapsed);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(BENCH_MAX_LIST_US_PER_ENTRY * 1000 + 1000, elapsed);
+
+} // test_filelist_pages()
+
+
+static void test_upload()
+{
+  for (size_t chunkSize : CHUNK_SIZES)
+  {
+    uint32_t start = micros();
+    const NativeResponse &answer = server.upload("/fsm/upload", "folder=/upload/", "file", "upload.bin",
+                                                 payload.data(), payload.size(), chunkSize);
+    uint32_t elapsed = micros() - start;
+    TEST_ASSERT_EQUAL_INT(200, answer.code);
+
+    File file = LittleFS.open("/upload/upload.bin", "r");
+    TEST_ASSERT_EQUAL_UINT32(payload.size(), file.size());
+    file.close();
+
+    uint32_t rate = kbPerSecond(payload.size(), elapsed);
+    printf("upload   %5u byte chunks: %8u KB/s\n", (unsigned)chunkSize, (unsigned)rate);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(BENCH_MIN_UPLOAD_KBPS, rate);
+  }
+
+} // test_upload()
+
+
+static void test_download()
+{
+  File file = LittleFS.open("/download.bin", "w");
+  file.write(payload.data(), payload.size());
+  file.close();
+
+  server.keepBody = false;
+  uint32_t total = 0;
+  for (int r = 0; r < REPEATS; r++)
+  {
+    uint32_t start = micros();
+    const NativeResponse &answer = server.request(HTTP_GET, "/fsm/download", "file=/download.bin");
+    total += micros() - start;
+    TEST_ASSERT_EQUAL_INT(200, answer.code);
+    TEST_ASSERT_EQUAL_UINT32(payload.size(), answer.bodyBytes);
+  }
+  server.keepBody = true;
+
+  uint32_t rate = kbPerSecond(payload.size() * REPEATS, total);
+  printf("download %5u KB file: %8u KB/s\n", (unsigned)(payload.size() / 1024), (unsigned)rate);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(BENCH_MIN_DOWNLOAD_KBPS, rate);
+
+} // test_download()
+
+
+static void test_gzip_download()
+{
+  // A .gz file is downloaded as it is, not as a gzip-encoded body
+  File file = LittleFS.open("/logs.gz", "w");
+  file.write(payload.data(), 1000);
+  file.close();
+
+  const NativeResponse &answer = server.request(HTTP_GET, "/fsm/download", "file=/logs.gz");
+  TEST_ASSERT_EQUAL_INT(200, answer.code);
+  TEST_ASSERT_EQUAL_UINT32(1000, answer.bodyBytes);
+  TEST_ASSERT_EQUAL_STRING("", answer.header("Content-Encoding").c_str());
+
+} // test_gzip_download()
+
+
+static void test_bad_range()
+{
+  // A Range that is ignored sends the whole gzipped sibling, with its
+  // Content-Encoding once
+  File file = LittleFS.open("/site.css.gz", "w");
+  file.write(payload.data(), 700);
+  file.close();
+
+  const NativeResponse &answer = server.request(HTTP_GET, "/fsm/download", "file=/site.css",
+                                                { { "Accept-Encoding", "gzip" }, { "Range", "bytes=0-9,20-29" } });
+  TEST_ASSERT_EQUAL_INT(200, answer.code);
+  TEST_ASSERT_EQUAL_UINT32(700, answer.bodyBytes);
+  int encodings = 0;
+  for (const auto &header : answer.headers)
+  {
+    if (header.first == "Content-Encoding") encodings++;
+  }
+  TEST_ASSERT_EQUAL_INT(1, encodings);
+
+} // test_bad_range()
+
+
+static void test_used_space()
+{
+  // Walks every folder made by the other benchmarks
+  int entries = 0;
+  for (int n : LIST_SIZES) entries += n + 1;
+
+  uint32_t total = 0;
+  for (int r = 0; r < REPEATS; r++)
+  {
+    uint32_t start = micros();
+    fsManager.resyncUsedSpace();
+    total += micros() - start;
+  }
+  uint32_t elapsed = total / REPEATS;
+  printf("used space walk, %d entries: %u us (%.2f us/entry)\n", entries, (unsigned)elapsed, (double)elapsed / entries);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(BENCH_MAX_USED_SPACE_US_PER_ENTRY * (uint32_t)entries + 1000, elapsed);
+
+} // test_used_space()
+
+
+static void test_system_files()
+{
+  // Added after begin() and out of hash order, as the examples do; the
+  // binary search must still find every entry, so every delete is refused
+  static const char* files[] = { "/zeta.js", "/app/index.html", "/a.css", "/favicon.ico", "/protected/deep/file.txt" };
+  for (const char* path : files)
+  {
+    File file = LittleFS.open(path, "w");
+    file.print(path);
+    file.close();
+  }
+  for (int i = 0; i < 4; i++) fsManager.addSystemFile(files[i], false);
+  fsManager.addSystemFolder("/protected");
+
+  char query[64];
+  for (const char* path : files)
+  {
+    snprintf(query, sizeof(query), "file=%s", path);
+    TEST_ASSERT_EQUAL_INT(403, server.request(HTTP_POST, "/fsm/delete", query).code);
+    TEST_ASSERT_TRUE_MESSAGE(LittleFS.exists(path), path);
+  }
+  TEST_ASSERT_EQUAL_INT(200, server.request(HTTP_POST, "/fsm/delete", "file=/list10/file0000.txt").code);
+
+} // test_system_files()
+
+
+int main()
+{
+  char root[] = "/tmp/fsmanager-bench-XXXXXX";
+  if (mkdtemp(root) == nullptr) return 1;
+  LittleFS.setRoot(root, 16 * 1024 * 1024);
+
+  for (int n : LIST_SIZES)
+  {
+    char folder[32];
+    snprintf(folder, sizeof(folder), "/list%d/", n);
+    makeFiles(folder, n);
+  }
+  payload.resize(TRANSFER_BYTES);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = (uint8_t)(i * 31 + (i >> 9));
+
+  Serial.muted = true;
+  fsManager.begin(&Serial);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_filelist);
+  RUN_TEST(test_filelist_pages);
+  RUN_TEST(test_upload);
+  RUN_TEST(test_download);
+  RUN_TEST(test_gzip_download);
+  RUN_TEST(test_bad_range);
+  RUN_TEST(test_used_space);
+  RUN_TEST(test_system_files);
+  int failures = UNITY_END();
+
+  std::string cleanup = std::string("rm -rf ") + root;
+  if (system(cleanup.c_str()) != 0) printf("Could not remove %s\n", root);
+  return failures;
+
+} // main()